@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 
 namespace globals {
 	inline unsigned int COLOR_BG = 0xff181818;
@@ -30,7 +31,15 @@ namespace globals {
 	inline const int AUDIO_COOLDOWN_MILLIS = 50;
 	inline const int AUDIO_DRUMSBUF_MILLIS = 20;
 	inline const int AUDIO_NOTE_LENGTH_MILLIS = 100; 
+	inline const int CC_RATE_MILLIS[] = { 0, 10, 5, 2, 1 }; // CC output intervals, 0 sends once per block
+	inline const int CC_DEADBAND_14BIT = 1; // 14 bit CC steps ignored as jitter
+	inline const int MIDI_OUT_CAPACITY = 256; // pending scheduled midi out messages
+	inline const int MIDI_IN_CAPACITY = 1024; // note ons queued per block, further notes in the same block are dropped
+	inline const double DELAY_MIN_TEMPO = 30.0; // slowest tempo delay lines are preallocated for
+	inline const size_t DELAY_MAX_BYTES = (size_t)256 << 20; // memory ceiling of the preallocated delay
+	inline const int MAX_CHANNELS = 16; // widest main bus accepted, 9.1.6 and smaller surround layouts
 	inline const int MAX_UNDO = 100;
+	inline const size_t UNDO_BUDGET_BYTES = (size_t)4 << 20; // history memory per instance, shared by all patterns and the sequencer
 
 	// view
 	inline const int PLUG_WIDTH = 640;
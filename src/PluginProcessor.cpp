@@ -2,6 +2,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "utils/RTAudit.h"
 #include <ctime>
 
 TIME12AudioProcessor::TIME12AudioProcessor()
@@ -53,34 +54,44 @@ TIME12AudioProcessor::TIME12AudioProcessor()
     options.storageFormat = PropertiesFile::storeAsXML;
     settings.setStorageParameters(options);
 
-    for (auto* param : getParameters()) {
-        param->addListener(this);
-    }
+    raw.mix = params.getRawParameterValue("mix");
+    raw.patsync = params.getRawParameterValue("patsync");
+    raw.trigger = params.getRawParameterValue("trigger");
+    raw.sync = params.getRawParameterValue("sync");
+    raw.rate = params.getRawParameterValue("rate");
+    raw.phase = params.getRawParameterValue("phase");
+    raw.min = params.getRawParameterValue("min");
+    raw.max = params.getRawParameterValue("max");
+    raw.smooth = params.getRawParameterValue("smooth");
+    raw.attack = params.getRawParameterValue("attack");
+    raw.release = params.getRawParameterValue("release");
+    raw.tension = params.getRawParameterValue("tension");
+    raw.tensionAtk = params.getRawParameterValue("tensionatk");
+    raw.tensionRel = params.getRawParameterValue("tensionrel");
+    raw.algo = params.getRawParameterValue("algo");
+    raw.threshold = params.getRawParameterValue("threshold");
+    raw.sense = params.getRawParameterValue("sense");
+    raw.lowcut = params.getRawParameterValue("lowcut");
+    raw.highcut = params.getRawParameterValue("highcut");
+    raw.offset = params.getRawParameterValue("offset");
 
     params.addParameterListener("pattern", this);
 
     // init patterns
     for (int i = 0; i < 12; ++i) {
-        patterns[i] = new Pattern(i);
-        patterns[i]->insertPoint(0.0, 0.0, 0, 0);
-        patterns[i]->insertPoint(1.0, 0.0, 0, 0);
-        patterns[i]->buildSegments();
+        patterns[i] = new Pattern(i, undoBudget);
+        patterns[i]->assignPoints({{0, 0.0, 0.0, 0, 0}, {0, 1.0, 0.0, 0, 0}});
     }
 
     // init paintMode Patterns
     for (int i = 0; i < PAINT_PATS; ++i) {
-        paintPatterns[i] = new Pattern(i + PAINT_PATS_IDX);
+        paintPatterns[i] = new Pattern(i + PAINT_PATS_IDX, undoBudget);
         if (i < 8) {
-            auto preset = Presets::getPaintPreset(i);
-            for (auto& point : preset) {
-                paintPatterns[i]->insertPoint(point.x, point.y, point.tension, point.type);
-            }
+            paintPatterns[i]->assignPoints(Presets::getPaintPreset(i));
         }
         else {
-            paintPatterns[i]->insertPoint(0.0, 0.0, 0.0, 1);
-            paintPatterns[i]->insertPoint(1.0, 1.0, 0.0, 1);
+            paintPatterns[i]->assignPoints({{0, 0.0, 0.0, 0.0, 1}, {0, 1.0, 1.0, 0.0, 1}});
         }
-        paintPatterns[i]->buildSegments();
     }
 
     sequencer = new Sequencer(*this);
@@ -92,10 +103,12 @@ TIME12AudioProcessor::TIME12AudioProcessor()
     value = new RCSmoother();
 
     loadSettings();
+    startTimerHz(30);
 }
 
 TIME12AudioProcessor::~TIME12AudioProcessor()
 {
+    stopTimer();
     params.removeParameterListener("pattern", this);
 }
 
@@ -109,17 +122,52 @@ void TIME12AudioProcessor::parameterChanged (const juce::String& parameterID, fl
     }
 }
 
-void TIME12AudioProcessor::parameterValueChanged (int parameterIndex, float newValue)
-{
-    (void)newValue;
-    (void)parameterIndex;
-    paramChanged = true;
-}
-
-void TIME12AudioProcessor::parameterGestureChanged (int parameterIndex, bool gestureIsStarting)
+/*
+    Loads the parameters into the typed snapshot ps
+    returns the ParamDeps groups whose inputs changed since the last read
+*/
+int TIME12AudioProcessor::readParams()
 {
-    (void)parameterIndex;
-    (void)gestureIsStarting;
+    ParamSnapshot p;
+    p.mix = (double)raw.mix->load();
+    p.patsync = (int)raw.patsync->load();
+    p.trigger = (int)raw.trigger->load();
+    p.sync = (int)raw.sync->load();
+    p.rate = (double)raw.rate->load();
+    p.phase = (double)raw.phase->load();
+    p.min = (double)raw.min->load();
+    p.max = (double)raw.max->load();
+    p.smooth = (double)raw.smooth->load();
+    p.attack = (double)raw.attack->load();
+    p.release = (double)raw.release->load();
+    p.tension = (double)raw.tension->load();
+    p.tensionAtk = (double)raw.tensionAtk->load();
+    p.tensionRel = (double)raw.tensionRel->load();
+    p.algo = (int)raw.algo->load();
+    p.threshold = (double)raw.threshold->load();
+    p.sense = (double)raw.sense->load();
+    p.lowcut = (double)raw.lowcut->load();
+    p.highcut = (double)raw.highcut->load();
+    p.offset = (double)raw.offset->load();
+    p.dualSmooth = dualSmooth;
+
+    int changed = 0;
+    if (p.trigger != ps.trigger)
+        changed |= DepTrigger;
+    if (p.sync != ps.sync)
+        changed |= DepSync;
+    if (p.rate != ps.rate)
+        changed |= DepRate;
+    if (p.dualSmooth != ps.dualSmooth || p.smooth != ps.smooth || p.attack != ps.attack || p.release != ps.release)
+        changed |= DepSmooth;
+    if (p.tension != ps.tension || p.tensionAtk != ps.tensionAtk || p.tensionRel != ps.tensionRel)
+        changed |= DepTension;
+    if (p.lowcut != ps.lowcut || p.highcut != ps.highcut)
+        changed |= DepFilters;
+
+    lps = ps;
+    ps = p;
+    return changed;
 }
 
 void TIME12AudioProcessor::loadSettings ()
@@ -136,16 +184,9 @@ void TIME12AudioProcessor::loadSettings ()
         for (int i = 0; i < PAINT_PATS; ++i) {
             auto str = file->getValue("paintpat" + String(i),"").toStdString();
             if (!str.empty()) {
-                paintPatterns[i]->clear();
                 paintPatterns[i]->clearUndo();
-                double x, y, tension;
-                int type;
-                std::istringstream iss(str);
-                while (iss >> x >> y >> tension >> type) {
-                    paintPatterns[i]->insertPoint(x,y,tension,type, false);
-                }
                 paintPatterns[i]->setTension(tensionparam, tensionatk, tensionrel, dualTension);
-                paintPatterns[i]->buildSegments();
+                paintPatterns[i]->assignPoints(Pattern::parsePoints(str));
             }
         }
     }
@@ -178,18 +219,18 @@ void TIME12AudioProcessor::setScale(float s)
 
 void TIME12AudioProcessor::resizeDelays(double srate, bool clear)
 {
-    auto sync = (int)params.getRawParameterValue("sync")->load();
+    const int sync = ps.sync;
     const int size = sync == 0
         ? (int)(srate * 10)
         : (int)(syncQN * srate * 60 / tempo);
 
-    delayL.resize(size, clear);
-    delayR.resize(size, clear);
+    floatLanes.delay.resize(size, clear);
+    doubleLanes.delay.resize(size, clear);
 
     if (sync == 0) {
-        auto ratehz = (double)params.getRawParameterValue("rate")->load();
-        delayL.resize((int)(srate / ratehz), clear);
-        delayR.resize((int)(srate / ratehz), clear);
+        auto ratehz = ps.rate;
+        floatLanes.delay.resize((int)(srate / ratehz), clear);
+        doubleLanes.delay.resize((int)(srate / ratehz), clear);
     }
 }
 
@@ -297,6 +338,11 @@ void TIME12AudioProcessor::toggleSequencerMode()
     );
 }
 
+Pattern* TIME12AudioProcessor::getAudioPattern(int index)
+{
+    return patterns[index];
+}
+
 Pattern* TIME12AudioProcessor::getPaintPatern(int index)
 {
     return paintPatterns[index];
@@ -325,13 +371,8 @@ void TIME12AudioProcessor::setPaintTool(int index)
 void TIME12AudioProcessor::restorePaintPatterns()
 {
     for (int i = 0; i < 8; ++i) {
-        paintPatterns[i]->clear();
         paintPatterns[i]->clearUndo();
-        auto preset = Presets::getPaintPreset(i);
-        for (auto& point : preset) {
-            paintPatterns[i]->insertPoint(point.x, point.y, point.tension, point.type);
-        }
-        paintPatterns[i]->buildSegments();
+        paintPatterns[i]->assignPoints(Presets::getPaintPreset(i));
     }
     sendChangeMessage();
 }
@@ -347,11 +388,10 @@ void TIME12AudioProcessor::toggleShowKnobs()
 
 void TIME12AudioProcessor::startMidiTrigger()
 {
-    double phase = (double)params.getRawParameterValue("phase")->load();
     clearDrawBuffers();
     midiTrigger = !alwaysPlaying;
     trigpos = 0.0;
-    trigphase = phase;
+    trigphase = ps.phase;
     restartEnv(true);
 }
 
@@ -424,21 +464,13 @@ void TIME12AudioProcessor::loadProgram (int index)
 
     currentProgram = index;
     auto loadPreset = [](Pattern& pat, int idx) {
-        auto preset = Presets::getPreset(idx);
-        pat.clear();
-        for (auto p = preset.begin(); p < preset.end(); ++p) {
-            pat.insertPoint(p->x, p->y, p->tension, p->type);
-        }
-        pat.buildSegments();
+        pat.assignPoints(Presets::getPreset(idx));
         pat.clearUndo();
     };
 
     if (index == 0) { // Init
         for (int i = 0; i < 12; ++i) {
-            patterns[i]->clear();
-            patterns[i]->insertPoint(0.0, 0.0, 0, 0);
-            patterns[i]->insertPoint(1.0, 0.0, 0, 0);
-            patterns[i]->buildSegments();
+            patterns[i]->assignPoints({{0, 0.0, 0.0, 0, 0}, {0, 1.0, 0.0, 0, 0}});
             patterns[i]->clearUndo();
         }
     }
@@ -478,33 +510,143 @@ void TIME12AudioProcessor::changeProgramName (int index, const juce::String& new
 //==============================================================================
 void TIME12AudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    (void)samplesPerBlock;
-    updateLatency(sampleRate);
-    lpFilterL.clear(0.0);
-    lpFilterR.clear(0.0);
-    hpFilterL.clear(0.0);
-    hpFilterR.clear(0.0);
-    transDetectorL.clear(sampleRate);
-    transDetectorR.clear(sampleRate);
-    resizeDelays(sampleRate, true);
-    setAntiNoise(anoise);
-    onSlider();
+    envBuffer.resize(samplesPerBlock, 0.0);
+    viewBuffer.resize(samplesPerBlock, 0.0);
+    hitBuffer.resize(samplesPerBlock, -1.0);
+
+    // per channel state is sized here so the audio thread never allocates for a layout
+    numChannels = std::max(1, getMainBusNumInputChannels());
+    int sideInputs = getBusCount(true) > 1 ? getChannelCountOfBus(true, 1) : 0;
+    monChannels = std::max(numChannels, sideInputs);
+    lpFilters.assign(monChannels, Filter());
+    hpFilters.assign(monChannels, Filter());
+    transDetectors.assign(monChannels, Transient());
+    for (auto& detector : transDetectors)
+        detector.clear(sampleRate);
+    monFrame.assign(monChannels, 0.0);
+    midiIn.clear();
+    midiIn.reserve(MIDI_IN_CAPACITY);
+    monBlock.assign((size_t)samplesPerBlock * monChannels, 0.0);
+
+    // delay lines are preallocated for the slowest sync at DELAY_MIN_TEMPO and the lowest rate,
+    // tempo and sync changes then only move the logical size within this capacity
+    double minRate = (double)params.getParameterRange("rate").start;
+    double maxSyncQN = 16.0; // 4 bars
+    int maxDelay = (int)std::ceil(std::max(sampleRate / minRate, maxSyncQN * sampleRate * 60 / DELAY_MIN_TEMPO));
+    int maxLatency = (int)(AUDIO_LATENCY_MILLIS / 1000.0 * sampleRate);
+    latMonitorBuffer.reserve((size_t)maxLatency * monChannels);
+
+    // only the lanes matching the host precision hold buffers, the other delay stays empty
+    auto prepareLanes = [&](auto& lanes) {
+        lanes.delay.setChannels(numChannels);
+        delayMaxSize = lanes.delay.reserve(maxDelay, DELAY_MAX_BYTES);
+        lanes.latBuffer.reserve((size_t)maxLatency * numChannels);
+        DBG("Delay preallocated " << (int)(lanes.delay.bytes() >> 10) << " KB, max delay "
+            << delayMaxSize << " of " << maxDelay << " samples");
+        lanes.inBlock.assign((size_t)samplesPerBlock * numChannels, 0);
+        lanes.delayedBlock.assign((size_t)samplesPerBlock * numChannels, 0);
+        lanes.outFrame.assign(numChannels, 0);
+        lanes.fadeFrame.assign(numChannels, 0);
+    };
+    auto releaseLanes = [](auto& lanes) {
+        lanes.delay.release();
+        lanes.latBuffer = {};
+        lanes.inBlock = {};
+        lanes.delayedBlock = {};
+        lanes.outFrame = {};
+        lanes.fadeFrame = {};
+    };
+    if (isUsingDoublePrecision()) {
+        prepareLanes(doubleLanes);
+        releaseLanes(floatLanes);
+    }
+    else {
+        prepareLanes(floatLanes);
+        releaseLanes(doubleLanes);
+    }
+
+    fadeCurve.reserve((size_t)(ANOISE_HIGH_MILLIS / 1000.0 * sampleRate) + 1);
+    readParams();
+    lps = ps; // no automation ramp into the first block
+    anoiseRequest = -1;
+    buildFadeCurve(anoise);
+    onSlider(DepAll); // rebuilds latency, delay sizes, smoother and filters for the new rate
 }
 
+/*
+    Message thread, the crossfade curve read by processBlock
+    is rebuilt on the audio thread at the start of the next block
+*/
 void TIME12AudioProcessor::setAntiNoise(ANoise mode)
 {
-    auto srate = getSampleRate();
     anoise = mode;
-    ansamps = anoise == ANOff ? 0
-        : anoise == ANLinear ? (int)(ANOISE_LIN_MILLIS / 1000.0 * srate)
-        : anoise == ANLow ? (int)(ANOISE_LOW_MILLIS / 1000.0 * srate)
+    anoiseRequest = mode;
+}
+
+/*
+    Audio thread or prepareToPlay, stays within the capacity reserved in prepareToPlay
+*/
+void TIME12AudioProcessor::buildFadeCurve(ANoise mode)
+{
+    auto srate = getSampleRate();
+    ansamps = mode == ANOff ? 0
+        : mode == ANLinear ? (int)(ANOISE_LIN_MILLIS / 1000.0 * srate)
+        : mode == ANLow ? (int)(ANOISE_LOW_MILLIS / 1000.0 * srate)
         : (int)(ANOISE_HIGH_MILLIS / 1000.0 * srate);
+    ansamps = std::min(ansamps, std::max(0, (int)fadeCurve.capacity() - 1));
+
+    // weight of the current read head for each remaining crossfade sample
+    fadeCurve.resize(ansamps + 1);
+    for (int i = 0; i <= ansamps; ++i) {
+        fadeCurve[i] = ansamps == 0 ? 1.0
+            : mode == ANLinear ? (double)(ansamps - i) / ansamps
+            : 0.5 * (1.0 + std::cos(MathConstants<double>::pi * i / ansamps));
+    }
+}
+
+void TIME12AudioProcessor::setEnvQuality(EnvQuality quality)
+{
+    envQuality = quality;
+    for (int i = 0; i < 12; ++i) {
+        patterns[i]->useTable = envQuality == EnvQuality::EnvTable;
+        patterns[i]->buildSegments();
+    }
+}
+
+/*
+    Handles the notifications posted by the audio thread
+    and rebuilds the patterns after tension changes
+*/
+void TIME12AudioProcessor::timerCallback()
+{
+    bool changed = false;
+    UIEvent event;
+    while (uiEvents.pop(event)) {
+        if (event.type == UIPatternChanged || event.type == UILatencyChanged) {
+            changed = true;
+        }
+        else if (event.type == UIModeRequest) {
+            setUIMode((UIMode)event.value);
+        }
+        else if (event.type == UISyncChanged) {
+            auto sync = (int)raw.sync->load();
+            if ((sync == 0 && !showKnobs) || (sync > 0 && showKnobs && !showAudioKnobs)) {
+                toggleShowKnobs();
+            }
+        }
+    }
+    if (changed)
+        sendChangeMessage();
+
+    // any number of tension changes since the last tick cost one rebuild,
+    // the audio thread adopts the new snapshots when it pins at the start of its next block
+    if (tensionDirty.exchange(false))
+        onTensionChange();
 }
 
 void TIME12AudioProcessor::updateLatency(double sampleRate)
 {
-    int trigger = (int)params.getRawParameterValue("trigger")->load();
-    int audioMillis = trigger == Trigger::Audio ? AUDIO_LATENCY_MILLIS : 0;
+    int audioMillis = ps.trigger == Trigger::Audio ? AUDIO_LATENCY_MILLIS : 0;
     setLatencySamples((int)(audioMillis / 1000.0 * sampleRate));
     clearLatencyBuffers();
 }
@@ -522,12 +664,10 @@ bool TIME12AudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) c
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // any main layout from mono up to MAX_CHANNELS is processed channel by channel,
+    // every channel shares the same envelope
+    auto channels = layouts.getMainOutputChannelSet().size();
+    if (channels < 1 || channels > MAX_CHANNELS)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -541,16 +681,19 @@ bool TIME12AudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) c
 }
 #endif
 
-void TIME12AudioProcessor::onSlider()
+/*
+    Recomputes the state derived from the parameter groups in changed
+    reads the values from ps, call readParams() first
+*/
+void TIME12AudioProcessor::onSlider(int changed)
 {
-    setSmooth();
     auto srate = getSampleRate();
+    if (changed & DepSmooth)
+        setSmooth();
 
-    int trigger = (int)params.getRawParameterValue("trigger")->load();
-    if (trigger != ltrigger) {
+    int trigger = ps.trigger;
+    if (changed & DepTrigger)
         updateLatency(srate);
-        ltrigger = trigger;
-    }
     if (trigger == Trigger::Sync && alwaysPlaying)
         alwaysPlaying = false; // force alwaysPlaying off when trigger is not MIDI or Audio
 
@@ -560,62 +703,66 @@ void TIME12AudioProcessor::onSlider()
     if (trigger != Trigger::Audio && audioTrigger)
         audioTrigger = false;
 
-    auto tension = (double)params.getRawParameterValue("tension")->load();
-    auto tensionatk = (double)params.getRawParameterValue("tensionatk")->load();
-    auto tensionrel = (double)params.getRawParameterValue("tensionrel")->load();
-    if (tension != ltension || tensionatk != ltensionatk || tensionrel != ltensionrel) {
-        onTensionChange();
-        ltensionatk = tensionatk;
-        ltensionrel = tensionrel;
-        ltension = tension;
+    if (changed & DepTension) {
+        if (isNonRealtime())
+            onTensionChange(); // offline renders rebuild on the block the change lands on, so bounces repeat exactly
+        else
+            tensionDirty = true; // rebuilt by timerCallback, never queued with events that must arrive
     }
 
-    auto sync = (int)params.getRawParameterValue("sync")->load();
-    if (sync == 0) syncQN = 1.; // not used
-    else if (sync == 1) syncQN = 1./64.; // 1/256
-    else if (sync == 2) syncQN = 1./32.; // 1/128
-    else if (sync == 3) syncQN = 1./16.; // 1/64
-    else if (sync == 4) syncQN = 1./8.; // 1/32
-    else if (sync == 5) syncQN = 1./4.; // 1/16
-    else if (sync == 6) syncQN = 1./2.; // 1/8
-    else if (sync == 7) syncQN = 1./1.; // 1/4
-    else if (sync == 8) syncQN = 1.*2.; // 1/2
-    else if (sync == 9) syncQN = 1.*4.; // 1bar
-    else if (sync == 10) syncQN = 1.*8.; // 2bar
-    else if (sync == 11) syncQN = 1.*16.; // 4bar
-    else if (sync == 12) syncQN = 1./6.; // 1/16t
-    else if (sync == 13) syncQN = 1./3.; // 1/8t
-    else if (sync == 14) syncQN = 2./3.; // 1/4t
-    else if (sync == 15) syncQN = 4./3.; // 1/2t
-    else if (sync == 16) syncQN = 8./3.; // 1/1t
-    else if (sync == 17) syncQN = 1./4.*1.5; // 1/16.
-    else if (sync == 18) syncQN = 1./2.*1.5; // 1/8.
-    else if (sync == 19) syncQN = 1./1.*1.5; // 1/4.
-    else if (sync == 20) syncQN = 2./1.*1.5; // 1/2.
-    else if (sync == 21) syncQN = 4./1.*1.5; // 1/1.
-    if (sync != lsync) {
+    int sync = ps.sync;
+    if (changed & DepSync) {
+        if (sync == 0) syncQN = 1.; // not used
+        else if (sync == 1) syncQN = 1./64.; // 1/256
+        else if (sync == 2) syncQN = 1./32.; // 1/128
+        else if (sync == 3) syncQN = 1./16.; // 1/64
+        else if (sync == 4) syncQN = 1./8.; // 1/32
+        else if (sync == 5) syncQN = 1./4.; // 1/16
+        else if (sync == 6) syncQN = 1./2.; // 1/8
+        else if (sync == 7) syncQN = 1./1.; // 1/4
+        else if (sync == 8) syncQN = 1.*2.; // 1/2
+        else if (sync == 9) syncQN = 1.*4.; // 1bar
+        else if (sync == 10) syncQN = 1.*8.; // 2bar
+        else if (sync == 11) syncQN = 1.*16.; // 4bar
+        else if (sync == 12) syncQN = 1./6.; // 1/16t
+        else if (sync == 13) syncQN = 1./3.; // 1/8t
+        else if (sync == 14) syncQN = 2./3.; // 1/4t
+        else if (sync == 15) syncQN = 4./3.; // 1/2t
+        else if (sync == 16) syncQN = 8./3.; // 1/1t
+        else if (sync == 17) syncQN = 1./4.*1.5; // 1/16.
+        else if (sync == 18) syncQN = 1./2.*1.5; // 1/8.
+        else if (sync == 19) syncQN = 1./1.*1.5; // 1/4.
+        else if (sync == 20) syncQN = 2./1.*1.5; // 1/2.
+        else if (sync == 21) syncQN = 4./1.*1.5; // 1/1.
         resizeDelays(srate, true);
-        if ((sync == 0 && !showKnobs) || (sync > 0 && showKnobs && !showAudioKnobs)) {
-            toggleShowKnobs();
-        }
+        uiEvents.push({ UISyncChanged, sync });
+    }
+    else if ((changed & DepRate) && sync == 0) {
+        resizeDelays(srate, false); // logical resize only, capacity was reserved in prepareToPlay
     }
-    lsync = sync;
 
-    auto highcut = (double)params.getRawParameterValue("highcut")->load();
-    auto lowcut = (double)params.getRawParameterValue("lowcut")->load();
-    lpFilterL.lp(srate, highcut, 0.707);
-    lpFilterR.lp(srate, highcut, 0.707);
-    hpFilterL.hp(srate, lowcut, 0.707);
-    hpFilterR.hp(srate, lowcut, 0.707);
+    if (changed & DepFilters) {
+        for (auto& filter : lpFilters)
+            filter.lp(srate, ps.highcut, 0.707);
+        for (auto& filter : hpFilters)
+            filter.hp(srate, ps.lowcut, 0.707);
+    }
 }
 
+/*
+    Rebuilds every pattern with the current tension, on the message thread
+    or on the audio thread during offline renders where allocating is allowed
+    all audio patterns are kept compiled so a queued pattern switch only acquires a snapshot
+*/
 void TIME12AudioProcessor::onTensionChange()
 {
-    auto tension = (double)params.getRawParameterValue("tension")->load();
-    auto tensionatk = (double)params.getRawParameterValue("tensionatk")->load();
-    auto tensionrel = (double)params.getRawParameterValue("tensionrel")->load();
-    pattern->setTension(tension, tensionatk, tensionrel, dualTension);
-    pattern->buildSegments();
+    auto tension = (double)raw.tension->load();
+    auto tensionatk = (double)raw.tensionAtk->load();
+    auto tensionrel = (double)raw.tensionRel->load();
+    for (int i = 0; i < 12; ++i) {
+        patterns[i]->setTension(tension, tensionatk, tensionrel, dualTension);
+        patterns[i]->buildSegments();
+    }
     for (int i = 0; i < PAINT_PATS; ++i) {
         paintPatterns[i]->setTension(tension, tensionatk, tensionrel, dualTension);
         paintPatterns[i]->buildSegments();
@@ -626,11 +773,11 @@ void TIME12AudioProcessor::onPlay()
 {
     clearDrawBuffers();
     clearLatencyBuffers();
-    delayL.clear();
-    delayR.clear();
-    int trigger = (int)params.getRawParameterValue("trigger")->load();
-    double ratehz = (double)params.getRawParameterValue("rate")->load();
-    double phase = (double)params.getRawParameterValue("phase")->load();
+    floatLanes.delay.clear();
+    doubleLanes.delay.clear();
+    int trigger = ps.trigger;
+    double ratehz = ps.rate;
+    double phase = ps.phase;
 
     midiTrigger = false;
     audioTrigger = false;
@@ -643,8 +790,8 @@ void TIME12AudioProcessor::onPlay()
 
     audioTriggerCountdown = -1;
     double srate = getSampleRate();
-    transDetectorL.clear(srate);
-    transDetectorR.clear(srate);
+    for (auto& detector : transDetectors)
+        detector.clear(srate);
 
     if (trigger == 0 || alwaysPlaying) {
         restartEnv(false);
@@ -653,10 +800,10 @@ void TIME12AudioProcessor::onPlay()
 
 void TIME12AudioProcessor::restartEnv(bool fromZero)
 {
-    int sync = (int)params.getRawParameterValue("sync")->load();
-    double min = (double)params.getRawParameterValue("min")->load();
-    double max = (double)params.getRawParameterValue("max")->load();
-    double phase = (double)params.getRawParameterValue("phase")->load();
+    int sync = ps.sync;
+    double min = ps.min;
+    double max = ps.max;
+    double phase = ps.phase;
 
     if (fromZero) { // restart from phase
         xpos = phase;
@@ -673,12 +820,12 @@ void TIME12AudioProcessor::restartEnv(bool fromZero)
 
 void TIME12AudioProcessor::onStop()
 {
-    delayL.clear();
-    delayR.clear();
+    floatLanes.delay.clear();
+    doubleLanes.delay.clear();
     clearLatencyBuffers();
     if (showLatencyWarning) {
         showLatencyWarning = false;
-        MessageManager::callAsync([this]() { sendChangeMessage(); });
+        uiEvents.push({ UILatencyChanged, 0 });
     }
 }
 
@@ -692,15 +839,12 @@ void TIME12AudioProcessor::clearLatencyBuffers()
 {
     if (getLatencySamples() != latency && playing) {
         showLatencyWarning = true;
-        MessageManager::callAsync([this]() { sendChangeMessage(); });
+        uiEvents.push({ UILatencyChanged, 0 });
     }
     latency = getLatencySamples();
-    latBufferL.resize(latency, 0.0);
-    latBufferR.resize(latency, 0.0);
-    latMonitorBufferL.resize(latency, 0.0);
-    latMonitorBufferR.resize(latency, 0.0);
-    std::fill(latBufferL.begin(), latBufferL.end(), 0.0);
-    std::fill(latBufferR.begin(), latBufferR.end(), 0.0);
+    floatLanes.latBuffer.assign(latency * floatLanes.delay.channels, 0.0f);
+    doubleLanes.latBuffer.assign(latency * doubleLanes.delay.channels, 0.0);
+    latMonitorBuffer.resize(latency * monChannels, 0.0);
     std::fill(monSamples.begin(), monSamples.end(), 0.0);
     writepos = 0;
 }
@@ -708,37 +852,37 @@ void TIME12AudioProcessor::clearLatencyBuffers()
 void TIME12AudioProcessor::toggleUseSidechain()
 {
     useSidechain = !useSidechain;
-    hpFilterL.clear(0.0);
-    hpFilterR.clear(0.0);
-    lpFilterL.clear(0.0);
-    lpFilterR.clear(0.0);
+    for (auto& filter : hpFilters)
+        filter.clear(0.0);
+    for (auto& filter : lpFilters)
+        filter.clear(0.0);
 }
 
 void TIME12AudioProcessor::toggleMonitorSidechain()
 {
     useMonitor = !useMonitor;
-    hpFilterL.clear(0.0);
-    hpFilterR.clear(0.0);
-    lpFilterL.clear(0.0);
-    lpFilterR.clear(0.0);
+    for (auto& filter : hpFilters)
+        filter.clear(0.0);
+    for (auto& filter : lpFilters)
+        filter.clear(0.0);
 }
 
 double inline TIME12AudioProcessor::getY(double x, double min, double max)
 {
-    return min + (max - min) * pattern->get_y_at(x);
+    return min + (max - min) * pattern->get_y_at(*patternSnapshot, envCursor, x);
 }
 
 void TIME12AudioProcessor::setSmooth()
 {
-    if (dualSmooth) {
-        float attack = params.getRawParameterValue("attack")->load();
-        float release = params.getRawParameterValue("release")->load();
+    if (ps.dualSmooth) {
+        float attack = (float)ps.attack;
+        float release = (float)ps.release;
         attack *= attack;
         release *= release;
         value->setup(attack * 0.25, release * 0.25, getSampleRate());
     }
     else {
-        float lfosmooth = params.getRawParameterValue("smooth")->load();
+        float lfosmooth = (float)ps.smooth;
         lfosmooth *= lfosmooth;
         value->setup(lfosmooth * 0.25, lfosmooth * 0.25, getSampleRate());
     }
@@ -748,7 +892,7 @@ void TIME12AudioProcessor::queuePattern(int patidx)
 {
     queuedPattern = patidx;
     queuedPatternCountdown = 0;
-    int patsync = (int)params.getRawParameterValue("patsync")->load();
+    int patsync = (int)raw.patsync->load(); // also called from the message thread
 
     if (playing && patsync != PatSync::Off) {
         int interval = samplesPerBeat;
@@ -764,6 +908,17 @@ void TIME12AudioProcessor::queuePattern(int patidx)
     }
 }
 
+template <>
+AudioLanes<float>& TIME12AudioProcessor::getLanes<float>()
+{
+    return floatLanes;
+}
+template <>
+AudioLanes<double>& TIME12AudioProcessor::getLanes<double>()
+{
+    return doubleLanes;
+}
+
 bool TIME12AudioProcessor::supportsDoublePrecisionProcessing() const
 {
     return true;
@@ -781,8 +936,15 @@ template <typename FloatType>
 void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals disableDenormals;
+    RTAudit::Scope audit("processBlock"); // reports allocations and locks in RT_AUDIT builds
+    patternSnapshot = pattern->acquireSnapshot();
+    const int changed = readParams(); // applied by onSlider once the tempo is read, before any early return
+    const int anoiseMode = anoiseRequest.exchange(-1);
+    if (anoiseMode >= 0)
+        buildFadeCurve((ANoise)anoiseMode);
     double srate = getSampleRate();
-    int sblock = getBlockSize();
+    const int64_t blockStart = sampleClock; // advances on every block, playing or not
+    sampleClock += buffer.getNumSamples();
     bool looping = false;
     double loopStart = 0.0;
     double loopEnd = 0.0;
@@ -790,7 +952,8 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
         clearLatencyBuffers();
     }
 
-    // Get playhead info
+    // Get playhead info, transport changes are applied once the derived state is refreshed
+    bool play = playing;
     if (auto* phead = getPlayHead()) {
         if (auto pos = phead->getPosition()) {
             if (auto tempo_ = pos->getBpm()) {
@@ -799,17 +962,6 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
                 samplesPerBeat = (int)((60.0 / *tempo_) * srate);
                 secondsPerBeat = 60.0 / *tempo_;
                 tempo = *tempo_;
-
-                if (ltempo != -1.0 && ltempo != tempo) {
-                    delayL.reserve((int)srate * 10); // tempo is changing, allocate memory so resizes become cheap
-                    delayR.reserve((int)srate * 10);
-                    resizeDelays(srate, false);
-                }
-                else if (tempo != ltempo) {
-                    resizeDelays(srate, false); // FIX - initial tempo only set after plugin starts
-                }
-
-                ltempo = tempo;
             }
             if (auto ppq = pos->getPpqPosition()) {
                 ppqPosition = *ppq;
@@ -819,17 +971,8 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
                 loopStart = loopPoints->ppqStart;
                 loopEnd = loopPoints->ppqEnd;
             }
-            auto play = pos->getIsPlaying();
-            bool playToggle = !playing && play;
-            bool stopToggle = playing && !play;
-            playing = play;
-
-            if (playToggle)
-                onPlay();
-            else if (stopToggle)
-                onStop();
-
-            if (playing) {
+            play = pos->getIsPlaying();
+            if (play) {
                 if (auto samples = pos->getTimeInSamples()) {
                     timeInSamples = *samples;
                 }
@@ -837,6 +980,26 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
         }
     }
 
+    // parameter changes update syncQN, delay sizes and latency with the tempo of this block
+    if (changed) {
+        RTAudit::Scope auditParams("onSlider");
+        onSlider(changed);
+        if ((changed & DepTension) && isNonRealtime())
+            patternSnapshot = pattern->acquireSnapshot();
+    }
+    if (tempo != ltempo && !(changed & DepSync)) { // sync changes already resized with this tempo
+        resizeDelays(srate, false); // logical resize only, capacity was reserved in prepareToPlay
+    }
+    ltempo = tempo;
+
+    bool playToggle = !playing && play;
+    bool stopToggle = playing && !play;
+    playing = play;
+    if (playToggle)
+        onPlay();
+    else if (stopToggle)
+        onStop();
+
     int inputBusCount = getBusCount(true);
     int audioOutputs = getTotalNumOutputChannels();
     int audioInputs = inputBusCount > 0 ? getChannelCountOfBus(true, 0) : 0;
@@ -845,27 +1008,49 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
     if (!audioInputs || !audioOutputs)
         return;
 
-    double mix = (double)params.getRawParameterValue("mix")->load();
-    int trigger = (int)params.getRawParameterValue("trigger")->load();
-    int sync = (int)params.getRawParameterValue("sync")->load();
-    double min = (double)params.getRawParameterValue("min")->load();
-    double max = (double)params.getRawParameterValue("max")->load();
-    double ratehz = (double)params.getRawParameterValue("rate")->load();
-    double phase = (double)params.getRawParameterValue("phase")->load();
-    double lowcut = (double)params.getRawParameterValue("lowcut")->load();
-    double highcut = (double)params.getRawParameterValue("highcut")->load();
-    int algo = (int)params.getRawParameterValue("algo")->load();
-    double threshold = (double)params.getRawParameterValue("threshold")->load();
-    double sense = 1.0 - (double)params.getRawParameterValue("sense")->load();
+    // the engine keeps the channel count it was prepared for, missing inputs repeat the last one
+    auto& lanes = getLanes<FloatType>();
+    auto& delay = lanes.delay;
+    auto interp = (DelayInterp)delayInterp.load();
+    int channels = (int)lanes.outFrame.size();
+    int sideChannels = std::min(sideInputs, monChannels);
+    const int blockCapacity = (int)envBuffer.size(); // scratch buffers hold this many samples
+    if (!channels || !blockCapacity)
+        return;
+
+    double mix = ps.mix;
+    int trigger = ps.trigger;
+    int sync = ps.sync;
+    double min = ps.min;
+    double max = ps.max;
+    double ratehz = ps.rate;
+    double lowcut = ps.lowcut;
+    double highcut = ps.highcut;
+    int algo = ps.algo;
+    double threshold = ps.threshold;
+    double sense = 1.0 - ps.sense;
     sense = std::pow(sense, 2); // make sensitivity more responsive
     int numSamples = buffer.getNumSamples();
+    // automation between two blocks is spread over the block so the result does not depend on the buffer size
+    const ParamRamp mixRamp(lps.mix, mix, numSamples);
+    const ParamRamp minRamp(lps.min, min, numSamples);
+    const ParamRamp maxRamp(lps.max, max, numSamples);
+    const ParamRamp phaseRamp = ParamRamp::cyclic(lps.phase, ps.phase, numSamples);
+    const ParamRamp rateRamp(lps.rate, ratehz, numSamples);
+    FloatType* const* chans = buffer.getArrayOfWritePointers(); // samples stay at host precision
+    bool fromSidechain = useSidechain && sideChannels > 0;
+    int detChannels = fromSidechain ? sideChannels : channels; // channels feeding the transient detectors
+    const double syncInc = beatsPerSample / syncQN;
+    int chunkStart = 0; // block sample at index 0 of the scratch buffers
 
     // processes draw wave samples
-    auto processDisplaySample = [&](int sampidx, double pos, double prelsamp, double prersamp) {
-        auto preamp = std::max(std::fabs(prelsamp), std::fabs(prersamp));
-        auto postlsamp = (double)buffer.getSample(0, sampidx);
-        auto postrsamp = audioInputs > 1 ? (double)buffer.getSample(1, sampidx) : postlsamp;
-        auto postamp = std::max(std::fabs(postlsamp), std::fabs(postrsamp));
+    auto processDisplaySample = [&](int sampidx, double pos, const FloatType* frame) {
+        double preamp = 0.0;
+        for (int c = 0; c < channels; ++c)
+            preamp = std::max(preamp, std::fabs((double)frame[c]));
+        double postamp = 0.0;
+        for (int c = 0; c < std::min(audioOutputs, channels); ++c)
+            postamp = std::max(postamp, std::fabs((double)chans[c][sampidx]));
         winpos = (int)std::floor(pos * viewW);
         if (lwinpos != winpos) {
             preSamples[winpos] = 0.0;
@@ -878,56 +1063,50 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
             postSamples[winpos] = postamp;
     };
 
-    auto processEnv = [&](int sampidx, double env, double lsamp, double rsamp) {
-        delayL.write(lsamp);
-        delayR.write(rsamp);
-        double outL, outR;
+    auto processEnv = [&](int sampidx, double env, const FloatType* frame) {
+        const FloatType wetMix = (FloatType)mixRamp.at(sampidx);
+        FloatType* out = lanes.outFrame.data();
+        delay.write(frame);
 
-        if (lypos == ypos) {
-            outL = delayL.read(1 + ypos * delayL.size);
-            outR = delayR.read(1 + ypos * delayR.size);
+        if (lypos == env) {
+            delay.read(1 + env * delay.size, out);
         }
         else {
-            // interpolate delay only when ypos is changing
-            outL = delayL.read3(1 + ypos * delayL.size);
-            outR = delayR.read3(1 + ypos * delayR.size);
+            // interpolate delay only when ypos is changing, the head speed sets the sinc cutoff
+            double speed = std::fabs(1.0 - (env - lypos) * delay.size);
+            delay.read(1 + env * delay.size, out, interp, speed);
         }
 
         // when y value jumps activate cross fade / anti-click
-        if (std::fabs(ypos - lypos) > 1e-3) {
+        // the old head stays on the sample it was reading, so it is read once per jump
+        FloatType* prev = lanes.fadeFrame.data();
+        if (std::fabs(env - lypos) > 1e-3) {
             xfade = ansamps;
-            xfadepos = 1 + lypos * delayL.size;
+            xfadepos = 1 + lypos * delay.size;
+            if (xfade > 0)
+                delay.read(xfadepos, prev, interp, 0.0);
         }
 
+        xfade = std::min(xfade, (int)fadeCurve.size() - 1); // anti-noise mode changed mid fade
         if (xfade > 0) {
-            if (anoise == ANLinear) {
-                outL = outL * (ansamps - xfade) / ansamps + delayL.read3(xfadepos + ansamps - xfade) * xfade / ansamps;
-                outR = outR * (ansamps - xfade) / ansamps + delayR.read3(xfadepos + ansamps - xfade) * xfade / ansamps;
-            }
-            else {
-                double fadeOut = 0.5 * (1.0 + std::cos(MathConstants<double>::pi * xfade / ansamps));
-                double fadeIn = 1.0 - fadeOut;
-
-                outL = outL * fadeOut + delayL.read3(xfadepos + ansamps - xfade) * fadeIn;
-                outR = outR * fadeOut + delayR.read3(xfadepos + ansamps - xfade) * fadeIn;
-            }
+            FloatType fadeOut = (FloatType)fadeCurve[xfade];
+            FloatType fadeIn = 1 - fadeOut;
+            for (int c = 0; c < channels; ++c)
+                out[c] = out[c] * fadeOut + prev[c] * fadeIn;
             xfade -= 1;
         }
 
         for (int channel = 0; channel < audioOutputs; ++channel) {
-            auto wet = channel == 0 ? outL : outR;
-            auto dry = (double)buffer.getSample(channel, sampidx);
-            if (outputCV)
-                buffer.setSample(channel, sampidx, static_cast<FloatType>(env));
-            else
-                buffer.setSample(channel, sampidx, static_cast<FloatType>(wet * mix + dry * (1.0 - mix)));
+            auto wet = out[std::min(channel, channels - 1)];
+            auto dry = chans[channel][sampidx];
+            chans[channel][sampidx] = outputCV ? static_cast<FloatType>(env) : wet * wetMix + dry * (1 - wetMix);
         }
 
-        lypos = ypos;
+        lypos = env;
     };
 
     double monIncrementPerSample = 1.0 / ((srate * 2) / monW); // 2 seconds of audio displayed on monitor
-    auto processMonitorSample = [&](double lsamp, double rsamp, bool hit) {
+    auto processMonitorSample = [&](const double* frame, int nchannels, bool hit) {
         double indexd = monpos.load();
         indexd += monIncrementPerSample;
 
@@ -939,7 +1118,9 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
             monSamples[index] = 0.0;
         lmonpos = index;
 
-        double maxamp = std::max(std::fabs(lsamp), std::fabs(rsamp));
+        double maxamp = 0.0;
+        for (int c = 0; c < nchannels; ++c)
+            maxamp = std::max(maxamp, std::fabs(frame[c]));
         if (hit || monSamples[index] >= 10.0)
             maxamp = std::max(maxamp + 10.0, hitamp + 10.0); // encode hits by adding +10 to amp
 
@@ -947,32 +1128,15 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
         monpos.store(indexd);
     };
 
-    // applies envelope to a sample index
-    auto applyGain = [&](int sampIdx, double env, double lsample, double rsample) {
-        for (int channel = 0; channel < audioOutputs; ++channel) {
-            auto wet = (channel == 0 ? lsample : rsample) * env;
-            auto dry = (double)buffer.getSample(channel, sampIdx);
-            if (outputCV) {
-                buffer.setSample(channel, sampIdx, static_cast<FloatType>(env));
-            }
-            else {
-                buffer.setSample(channel, sampIdx, static_cast<FloatType>(wet * mix + dry * (1.0 - mix)));
-            }
-        }
-    };
-
-    if (paramChanged) {
-        onSlider();
-        paramChanged = false;
-    }
-
-    // Process new MIDI messages
+    // Queue the note ons of this block, MidiBuffer iterates in sample order so the queue stays sorted
+    // and is consumed by midiCursor as the sub-blocks advance
+    midiIn.clear();
+    int midiCursor = 0;
     for (const auto metadata : midiMessages) {
         juce::MidiMessage message = metadata.getMessage();
-        if (message.isNoteOn() || message.isNoteOff()) {
-            midiIn.push_back({ // queue midi message
-                metadata.samplePosition,
-                message.isNoteOn(),
+        if (message.isNoteOn() && midiIn.size() < midiIn.capacity()) {
+            midiIn.push_back({
+                std::clamp(metadata.samplePosition, 0, std::max(0, numSamples - 1)),
                 message.getNoteNumber(),
                 message.getVelocity(),
                 message.getChannel() - 1
@@ -980,31 +1144,36 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
         }
     }
 
-    // Process midi out queue
-    for (auto it = midiOut.begin(); it != midiOut.end();) {
-        auto& [msg, offset] = *it;
-
-        if (offset < sblock) {
-            midiMessages.addEvent(msg, offset);
-            it = midiOut.erase(it);
+    // sends the envelope value y as CC unless it is within the dead-band of the last value sent
+    const bool hiresCC = highResCC && outputCC <= 32;
+    const int ccTarget = outputCC | outputCCChan << 8 | (int)hiresCC << 12 | (int)bipolarCC << 13;
+    if (ccTarget != lastCCTarget) {
+        lastCC = -1;
+        lastCCTarget = ccTarget;
+    }
+    auto sendCC = [&](double y, int offset) {
+        int val = hiresCC ? (int)std::round(y * 16383.0) : (int)std::round(y * 127.0);
+        if (lastCC >= 0 && std::abs(val - lastCC) <= (hiresCC ? CC_DEADBAND_14BIT : 0))
+            return;
+        lastCC = val;
+        if (bipolarCC) val -= hiresCC ? 8192 : 64;
+        if (hiresCC) {
+            midiMessages.addEvent(MidiMessage::controllerEvent(outputCCChan + 1, outputCC - 1, (val >> 7) & 127), offset);
+            midiMessages.addEvent(MidiMessage::controllerEvent(outputCCChan + 1, outputCC - 1 + 32, val & 127), offset);
         }
         else {
-            offset -= sblock;
-            ++it;
+            midiMessages.addEvent(MidiMessage::controllerEvent(outputCCChan + 1, outputCC - 1, val), offset);
         }
-    }
+    };
+
+    // CC on an interval grid of the sample clock, so the resolution does not depend on the block size
+    const int64_t ccInterval = CC_RATE_MILLIS[outputCCRate] > 0
+        ? std::max<int64_t>(1, (int64_t)(CC_RATE_MILLIS[outputCCRate] / 1000.0 * srate))
+        : 0;
 
-    // remove midi in messages that have been processed
-    midiIn.erase(std::remove_if(midiIn.begin(), midiIn.end(), [](const MidiInMsg& msg) {
-        return msg.offset < 0;
-    }), midiIn.end());
-
-    // update outputs with last envelope value at the start of the block
-    if (outputCC > 0) {
-        auto val = (int)std::round(ypos*127.0);
-        if (bipolarCC) val -= 64;
-        auto cc = MidiMessage::controllerEvent(outputCCChan + 1, outputCC-1, val);
-        midiMessages.addEvent(cc, 0);
+    // once per block mode updates outputs with last envelope value at the start of the block
+    if (outputCC > 0 && ccInterval == 0) {
+        sendCC(ypos, 0);
     }
 
     // keep beatPos in sync with playhead so plugin can be bypassed and return to its sync pos
@@ -1014,50 +1183,106 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
         ratePos = beatPos * secondsPerBeat * ratehz;
     }
 
-    for (int sample = 0; sample < numSamples; ++sample) {
-        if (playing && looping && beatPos >= loopEnd) {
-            beatPos = loopStart + (beatPos - loopEnd);
-            ratePos = beatPos * secondsPerBeat * ratehz;
+    // The block is processed in chunks that fit the scratch buffers, each chunk is split
+    // into sub-blocks at MIDI notes, pattern switches and audio trigger hits.
+    // Inside a sub-block every stage is a loop over contiguous buffers:
+    // positions -> envelope -> smoothing -> delay and mix -> telemetry
+
+    // copies the main inputs into interleaved frames before any output is written
+    auto gatherInputs = [&](int start, int end) {
+        FloatType* frames = lanes.inBlock.data();
+        for (int c = 0; c < channels; ++c) {
+            const FloatType* src = chans[std::min(c, audioInputs - 1)];
+            for (int i = start; i < end; ++i)
+                frames[(i - start) * channels + c] = src[i];
         }
+    };
 
-        // process midi in queue
-        for (auto& msg : midiIn) {
-            if (msg.offset == 0) {
-                if (msg.isNoteon) {
-                    if (msg.channel == triggerChn || triggerChn == 16) {
-                        auto patidx = msg.note % 12;
-                        queuePattern(patidx + 1);
-                    }
-                    if (trigger == Trigger::MIDI && (msg.channel == midiTriggerChn || midiTriggerChn == 16)) {
-                        if (queuedPattern) {
-                            queuedMidiTrigger = true;
-                        }
-                        else {
-                            startMidiTrigger();
-                        }
-                    }
+    // audio trigger detection, independent of the envelope so it runs ahead for the whole chunk
+    // hitBuffer keeps the amplitude of each trigger hit or -1
+    auto detectTransients = [&](int start, int end) {
+        for (int i = start; i < end; ++i) {
+            const int k = i - start;
+            const FloatType* frame = lanes.inBlock.data() + k * channels;
+
+            // process latency buffers
+            std::copy_n(frame, channels, lanes.latBuffer.begin() + writepos * channels);
+            readpos = latency == 0 ? latency : (writepos + 1) % latency;
+            std::copy_n(lanes.latBuffer.begin() + readpos * channels, channels, lanes.delayedBlock.begin() + k * channels);
+
+            // read sidechain samples
+            for (int c = 0; c < detChannels; ++c) {
+                monFrame[c] = fromSidechain
+                    ? (double)chans[audioInputs + c][i]
+                    : (double)frame[c];
+            }
+
+            // Detect audio transients
+            double* monWrite = latMonitorBuffer.data() + writepos * monChannels;
+            int hitChannel = -1;
+            for (int c = 0; c < detChannels; ++c) {
+                auto monSample = monFrame[c];
+                if (lowcut > 20.0)
+                    monSample = hpFilters[c].df1(monSample);
+                if (highcut < 20000.0)
+                    monSample = lpFilters[c].df1(monSample);
+                monWrite[c] = monSample;
+            }
+            for (int c = 0; c < detChannels && hitChannel == -1; ++c) {
+                if (transDetectors[c].detect(algo, monWrite[c], threshold, sense))
+                    hitChannel = c;
+            }
+            if (hitChannel > -1) {
+                for (int c = 0; c < detChannels; ++c)
+                    transDetectors[c].startCooldown();
+                int offset = (int)(ps.offset * AUDIO_LATENCY_MILLIS / 1000.0 * srate);
+                audioTriggerCountdown = std::max(0, latency + offset);
+                hitamp = std::fabs(monWrite[hitChannel]);
+            }
+            auto hit = audioTriggerCountdown == 0; // there was an audio transient trigger in this sample
+            hitBuffer[k] = hit ? hitamp : -1.0;
+
+            // read the monitor frame 'latency' samples ago
+            const double* monRead = latMonitorBuffer.data() + readpos * monChannels;
+            processMonitorSample(monRead, detChannels, hit);
+            std::copy_n(monRead, detChannels, monBlock.begin() + k * monChannels);
+
+            if (audioTriggerCountdown > -1)
+                audioTriggerCountdown -= 1;
+
+            writepos = latency == 0 ? 0 : (writepos + 1) % latency;
+        }
+    };
+
+    // applies the MIDI notes and pattern switch due on sample s
+    auto handleEvents = [&](int s) {
+        RTAudit::Scope auditEvents("handleEvents");
+        for (; midiCursor < (int)midiIn.size() && midiIn[midiCursor].offset <= s; ++midiCursor) {
+            auto& msg = midiIn[midiCursor];
+            if (msg.channel == triggerChn || triggerChn == 16) {
+                auto patidx = msg.note % 12;
+                queuePattern(patidx + 1);
+            }
+            if (trigger == Trigger::MIDI && (msg.channel == midiTriggerChn || midiTriggerChn == 16)) {
+                if (queuedPattern) {
+                    queuedMidiTrigger = true;
+                }
+                else {
+                    startMidiTrigger();
                 }
             }
-            msg.offset -= 1;
         }
 
         // process queued pattern
         if (queuedPattern) {
             if (!playing || queuedPatternCountdown == 0) {
-                if (sequencer->isOpen) {
-                    sequencer->close();
-                    setUIMode(UIMode::Normal);
-                }
+                // the sequencer is closed on the message thread, it restores the pattern it was opened on
+                if (sequencer->isOpen)
+                    uiEvents.push({ UIModeRequest, UIMode::Normal });
                 pattern = patterns[queuedPattern - 1];
                 viewPattern = pattern;
-                auto tension = (double)params.getRawParameterValue("tension")->load();
-                auto tensionatk = (double)params.getRawParameterValue("tensionatk")->load();
-                auto tensionrel = (double)params.getRawParameterValue("tensionrel")->load();
-                pattern->setTension(tension, tensionatk, tensionrel, dualTension);
-                pattern->buildSegments();
-                MessageManager::callAsync([this]() {
-                    sendChangeMessage();
-                });
+                patternSnapshot = pattern->acquireSnapshot();
+                uiEvents.push({ UIPatternChanged, queuedPattern });
                 queuedPattern = 0;
                 if (queuedMidiTrigger) {
                     queuedMidiTrigger = false;
@@ -1068,180 +1293,198 @@ void TIME12AudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, j
                 queuedPatternCountdown -= 1;
             }
         }
+    };
 
-        // Sync mode
-        if (trigger == Trigger::Sync) {
-            xpos = sync > 0
-                ? beatPos / syncQN + phase
-                : ratePos + phase;
-            xpos -= std::floor(xpos);
-
-            double newypos = getY(xpos, min, max);
-            ypos = value->process(newypos, newypos > ypos);
-
-            double lsample = (double)buffer.getSample(0, sample);
-            double rsample = (double)buffer.getSample(audioInputs > 1 ? 1 : 0, sample);
-            processEnv(sample, ypos, lsample, rsample);
-            processDisplaySample(sample, xpos, lsample, rsample);
-        }
-
-        // MIDI mode
-        else if (trigger == Trigger::MIDI) {
-            auto inc = sync > 0
-                ? beatsPerSample / syncQN
-                : 1 / srate * ratehz;
-            xpos += inc;
-            trigpos += inc;
-            xpos -= std::floor(xpos);
-
-            if (!alwaysPlaying) {
-                if (midiTrigger) {
-                    if (trigpos >= 1.0) { // envelope finished, stop midiTrigger
-                        midiTrigger = false;
-                        xpos = phase ? phase : 1.0;
-                    }
-                }
-                else {
-                    xpos = phase ? phase : 1.0; // midiTrigger is stopped, hold last position
+    // first sample after s0 where an event is due
+    auto nextEvent = [&](int s0, int end) {
+        int s1 = end;
+        if (midiCursor < (int)midiIn.size()) // notes up to s0 were consumed by handleEvents
+            s1 = std::min(s1, midiIn[midiCursor].offset);
+        if (queuedPattern && playing)
+            s1 = (int)std::min<int64_t>(s1, s0 + queuedPatternCountdown + 1);
+        if (trigger == Trigger::Audio) {
+            for (int i = s0 + 1; i < s1; ++i) {
+                if (hitBuffer[i - chunkStart] >= 0.0) {
+                    s1 = i;
+                    break;
                 }
             }
-
-            double newypos = getY(xpos, min, max);
-            ypos = value->process(newypos, newypos > ypos);
-
-            double lsample = (double)buffer.getSample(0, sample);
-            double rsample = (double)buffer.getSample(audioInputs > 1 ? 1 : 0, sample);
-            double viewpos = (alwaysPlaying || midiTrigger) ? xpos
-                : (trigpos + trigphase) - std::floor(trigpos + trigphase);
-
-            processEnv(sample, ypos, lsample, rsample);
-            processDisplaySample(sample, viewpos, lsample, rsample);
         }
+        return s1;
+    };
 
-        // Audio mode
-        else if (trigger == Trigger::Audio) {
-            // process latency buffers
-            latBufferL[writepos] = (double)buffer.getSample(0, sample);
-            latBufferR[writepos] = (double)buffer.getSample(audioInputs > 1 ? 1 : 0, sample);
-            readpos = latency == 0 ? latency : (writepos + 1) % latency;
-            double lsample = latBufferL[readpos]; // delayed sample
-            double rsample = latBufferR[readpos]; // delayed sample
-
-            // read sidechain samples
-            double lrawsample = (double)buffer.getSample(0, sample);
-            double rrawsample = (double)buffer.getSample(audioInputs > 1 ? 1 : 0, sample);
-            if (useSidechain && sideInputs) {
-                lrawsample = (double)buffer.getSample(audioInputs, sample);
-                rrawsample = (double)buffer.getSample(sideInputs > 1 ? audioInputs + 1 : audioInputs, sample);
+    // advances the transport and trigger state, writes x and the view position per sample
+    auto advancePositions = [&](int s0, int s1) {
+        for (int sample = s0; sample < s1; ++sample) {
+            const int k = sample - chunkStart;
+            const double rate = rateRamp.at(sample);
+            double phase = phaseRamp.at(sample);
+            phase -= std::floor(phase); // 1 wraps to 0, the same position on the cycle
+            const double inc = sync > 0 ? syncInc : 1 / srate * rate;
+            if (playing && looping && beatPos >= loopEnd) {
+                beatPos = loopStart + (beatPos - loopEnd);
+                ratePos = beatPos * secondsPerBeat * rate;
             }
 
-            // Detect audio transients
-            auto monSampleL = lrawsample;
-            auto monSampleR = rrawsample;
-            if (lowcut > 20.0) {
-                monSampleL = hpFilterL.df1(monSampleL);
-                monSampleR = hpFilterR.df1(monSampleR);
+            double viewpos = xpos;
+            // Sync mode
+            if (trigger == Trigger::Sync) {
+                xpos = sync > 0
+                    ? beatPos / syncQN + phase
+                    : ratePos + phase;
+                xpos -= std::floor(xpos);
+                viewpos = xpos;
             }
-            if (highcut < 20000.0) {
-                monSampleL = lpFilterL.df1(monSampleL);
-                monSampleR = lpFilterR.df1(monSampleR);
-            }
-            latMonitorBufferL[writepos] = monSampleL;
-            latMonitorBufferR[writepos] = monSampleR;
 
-            if (transDetectorL.detect(algo, monSampleL, threshold, sense) ||
-                transDetectorR.detect(algo, monSampleR, threshold, sense))
-            {
-                transDetectorL.startCooldown();
-                transDetectorR.startCooldown();
-                int offset = (int)(params.getRawParameterValue("offset")->load() * AUDIO_LATENCY_MILLIS / 1000.f * srate);
-                audioTriggerCountdown = std::max(0, latency + offset);
-                hitamp = transDetectorL.hit ? std::fabs(monSampleL) : std::fabs(monSampleR);
+            // MIDI mode
+            else if (trigger == Trigger::MIDI) {
+                xpos += inc;
+                trigpos += inc;
+                xpos -= std::floor(xpos);
+
+                if (!alwaysPlaying) {
+                    if (midiTrigger) {
+                        if (trigpos >= 1.0) { // envelope finished, stop midiTrigger
+                            midiTrigger = false;
+                            xpos = phase ? phase : 1.0;
+                        }
+                    }
+                    else {
+                        xpos = phase ? phase : 1.0; // midiTrigger is stopped, hold last position
+                    }
+                }
+                viewpos = (alwaysPlaying || midiTrigger) ? xpos
+                    : (trigpos + trigphase) - std::floor(trigpos + trigphase);
             }
-            auto hit = audioTriggerCountdown == 0; // there was an audio transient trigger in this sample
 
-            // read the monitor sample 'latency' samples ago
-            monSampleL = latMonitorBufferL[readpos];
-            monSampleR = latMonitorBufferR[readpos];
-            processMonitorSample(monSampleL, monSampleR, hit);
-
-            // envelope processing
-            auto inc = sync > 0
-                ? beatsPerSample / syncQN
-                : 1 / srate * ratehz;
-            xpos += inc;
-            trigpos += inc;
-            trigposSinceHit += inc;
-            xpos -= std::floor(xpos);
-
-            // send output midi notes on audio trigger hit
-            if (hit && outputATMIDI > 0) {
-                auto noteOn = MidiMessage::noteOn(1, outputATMIDI - 1, (float)hitamp);
-                midiMessages.addEvent(noteOn, sample);
-
-                auto offnoteDelay = static_cast<int>(srate * AUDIO_NOTE_LENGTH_MILLIS / 1000.0);
-                int noteOffSample = sample + offnoteDelay;
-                auto noteOff = MidiMessage::noteOff(1, outputATMIDI - 1);
-
-                if (noteOffSample < sblock) {
-                    midiMessages.addEvent(noteOff, noteOffSample);
-                }
-                else {
-                    int offset = noteOffSample - sblock;
-                    midiOut.push_back({ noteOff, offset });
+            // Audio mode
+            else if (trigger == Trigger::Audio) {
+                xpos += inc;
+                trigpos += inc;
+                trigposSinceHit += inc;
+                xpos -= std::floor(xpos);
+
+                double hit = hitBuffer[k];
+                // send output midi notes on audio trigger hit
+                if (hit >= 0.0 && outputATMIDI > 0) {
+                    auto noteOn = MidiMessage::noteOn(1, outputATMIDI - 1, (float)hit);
+                    midiMessages.addEvent(noteOn, sample);
+
+                    // the note off is sent from the scheduler, in this block or a later one
+                    auto offnoteDelay = static_cast<int64_t>(srate * AUDIO_NOTE_LENGTH_MILLIS / 1000.0);
+                    midiOut.push(blockStart + sample + offnoteDelay, 0x80, (uint8_t)(outputATMIDI - 1), 0);
                 }
-            }
 
-            if (hit && (alwaysPlaying || !audioIgnoreHitsWhilePlaying || trigposSinceHit > 0.98)) {
-                clearDrawBuffers();
-                audioTrigger = !alwaysPlaying;
-                trigpos = 0.0;
-                trigphase = phase;
-                trigposSinceHit = 0.0;
-                restartEnv(true);
-            }
+                if (hit >= 0.0 && (alwaysPlaying || !audioIgnoreHitsWhilePlaying || trigposSinceHit > 0.98)) {
+                    clearDrawBuffers();
+                    audioTrigger = !alwaysPlaying;
+                    trigpos = 0.0;
+                    trigphase = phase;
+                    trigposSinceHit = 0.0;
+                    restartEnv(true);
+                }
 
-            if (!alwaysPlaying) {
-                if (audioTrigger) {
-                    if (trigpos >= 1.0) { // envelope finished, stop trigger
-                        audioTrigger = false;
-                        xpos = phase ? phase : 1.0;
+                if (!alwaysPlaying) {
+                    if (audioTrigger) {
+                        if (trigpos >= 1.0) { // envelope finished, stop trigger
+                            audioTrigger = false;
+                            xpos = phase ? phase : 1.0;
+                        }
+                    }
+                    else {
+                        xpos = phase ? phase : 1.0; // audioTrigger is stopped, hold last position
                     }
                 }
-                else {
-                    xpos = phase ? phase : 1.0; // audioTrigger is stopped, hold last position
+                viewpos = (alwaysPlaying || audioTrigger) ? xpos
+                    : (trigpos + trigphase) - std::floor(trigpos + trigphase);
+            }
+
+            envBuffer[k] = xpos;
+            viewBuffer[k] = viewpos;
+            beatPos += beatsPerSample;
+            ratePos += 1 / srate * rate;
+            if (playing)
+                timeInSamples += 1;
+        }
+    };
+
+    for (; chunkStart < numSamples; chunkStart += blockCapacity) {
+        const int chunkEnd = std::min(numSamples, chunkStart + blockCapacity);
+        gatherInputs(chunkStart, chunkEnd);
+        if (trigger == Trigger::Audio)
+            detectTransients(chunkStart, chunkEnd);
+
+        // the audio mode envelope runs on the latency delayed input
+        const FloatType* frames = trigger == Trigger::Audio
+            ? lanes.delayedBlock.data()
+            : lanes.inBlock.data();
+
+        int s0 = chunkStart;
+        while (s0 < chunkEnd) {
+            handleEvents(s0);
+            const int s1 = nextEvent(s0, chunkEnd);
+            const int k0 = s0 - chunkStart;
+            const int len = s1 - s0;
+            if (queuedPattern && queuedPatternCountdown > 0) // countdown of the samples after s0
+                queuedPatternCountdown = std::max<int64_t>(0, queuedPatternCountdown - (len - 1));
+
+            advancePositions(s0, s1);
+
+            // envelope
+            double* env = envBuffer.data() + k0;
+            pattern->renderPositions(*patternSnapshot, env, len);
+            if (minRamp.active() || maxRamp.active()) {
+                for (int k = 0; k < len; ++k) {
+                    const double lo = minRamp.at(s0 + k);
+                    env[k] = lo + (maxRamp.at(s0 + k) - lo) * env[k];
                 }
             }
+            else {
+                for (int k = 0; k < len; ++k)
+                    env[k] = min + (max - min) * env[k];
+            }
+
+            // smoothing
+            for (int k = 0; k < len; ++k) {
+                ypos = value->process(env[k], env[k] > ypos);
+                env[k] = ypos;
+            }
 
-            double newypos = getY(xpos, min, max);
-            ypos = value->process(newypos, newypos > ypos);
+            // cc output on the grid points of this sub-block
+            if (outputCC > 0 && ccInterval > 0) {
+                int64_t t = (blockStart + s0 + ccInterval - 1) / ccInterval * ccInterval;
+                for (; t < blockStart + s1; t += ccInterval)
+                    sendCC(env[t - blockStart - s0], (int)(t - blockStart));
+            }
 
-            if (useMonitor) {
+            // delay and mix
+            if (trigger == Trigger::Audio && useMonitor) {
                 for (int channel = 0; channel < audioOutputs; ++channel) {
-                    buffer.setSample(channel, sample, static_cast<FloatType>(channel == 0 ? monSampleL : monSampleR));
+                    const int c = std::min(channel, detChannels - 1);
+                    for (int k = k0; k < k0 + len; ++k)
+                        chans[channel][chunkStart + k] = static_cast<FloatType>(monBlock[k * monChannels + c]);
                 }
             }
             else {
-                processEnv(sample, ypos, lsample, rsample);
+                for (int k = k0; k < k0 + len; ++k)
+                    processEnv(chunkStart + k, envBuffer[k], frames + k * channels);
             }
 
-            auto viewpos = (alwaysPlaying || audioTrigger) ? xpos
-                : (trigpos + trigphase) - std::floor(trigpos + trigphase);
-            processDisplaySample(sample, viewpos, lsample, rsample);
-
-            if (audioTriggerCountdown > -1)
-                audioTriggerCountdown -= 1;
+            // telemetry
+            for (int k = k0; k < k0 + len; ++k)
+                processDisplaySample(chunkStart + k, viewBuffer[k], frames + k * channels);
+            xenv.store(xpos);
+            yenv.store(1.0 - ypos);
 
-            writepos = latency == 0 ? 0 : (writepos + 1) % latency;
+            s0 = s1;
         }
-
-        xenv.store(xpos);
-        yenv.store(1.0-ypos);
-        beatPos += beatsPerSample;
-        ratePos += 1 / srate * ratehz;
-        if (playing)
-            timeInSamples += 1;
     }
+
+    // send the scheduled midi out messages due in this block
+    midiOut.drain(blockStart, numSamples, [&](const uint8_t* data, int offset) {
+        midiMessages.addEvent(data, 3, offset);
+    });
+
     drawSeek.store(playing && (trigger == Trigger::Sync || midiTrigger || audioTrigger));
 }
 
@@ -1274,10 +1517,14 @@ void TIME12AudioProcessor::getStateInformation (juce::MemoryBlock& destData)
     state.setProperty("outputCV", outputCV, nullptr);
     state.setProperty("outputATMIDI", outputATMIDI, nullptr);
     state.setProperty("bipolarCC", bipolarCC, nullptr);
+    state.setProperty("highResCC", highResCC, nullptr);
+    state.setProperty("outputCCRate", outputCCRate, nullptr);
     state.setProperty("paintTool", paintTool, nullptr);
     state.setProperty("paintPage", paintPage, nullptr);
     state.setProperty("pointMode", pointMode, nullptr);
     state.setProperty("anoise", anoise, nullptr);
+    state.setProperty("envQuality", envQuality, nullptr);
+    state.setProperty("delayInterp", delayInterp.load(), nullptr);
     state.setProperty("audioIgnoreHitsWhilePlaying", audioIgnoreHitsWhilePlaying, nullptr);
     state.setProperty("linkSeqToGrid", linkSeqToGrid, nullptr);
     state.setProperty("currpattern", pattern->index + 1, nullptr);
@@ -1341,6 +1588,8 @@ void TIME12AudioProcessor::setStateInformation (const void* data, int sizeInByte
         outputCC = (int)state.getProperty("outputCC");
         outputCCChan = (int)state.getProperty("outputCCChan");
         bipolarCC = (bool)state.getProperty("bipolarCC");
+        highResCC = state.hasProperty("highResCC") ? (bool)state.getProperty("highResCC") : false;
+        outputCCRate = state.hasProperty("outputCCRate") ? std::clamp((int)state.getProperty("outputCCRate"), 0, (int)std::size(CC_RATE_MILLIS) - 1) : 0;
         outputCV = (bool)state.getProperty("outputCV");
         outputATMIDI = (int)state.getProperty("outputATMIDI");
         paintTool = (int)state.getProperty("paintTool");
@@ -1348,28 +1597,22 @@ void TIME12AudioProcessor::setStateInformation (const void* data, int sizeInByte
         pointMode = state.hasProperty("pointMode") ? (int)state.getProperty("pointMode") : 0;
         audioIgnoreHitsWhilePlaying = (bool)state.getProperty("audioIgnoreHitsWhilePlaying");
         anoise = state.hasProperty("anoise") ? (ANoise)(int)state.getProperty("anoise") : anoise;
+        envQuality = state.hasProperty("envQuality") ? (EnvQuality)(int)state.getProperty("envQuality") : EnvQuality::EnvExact;
+        delayInterp = state.hasProperty("delayInterp") ? (int)state.getProperty("delayInterp") : (int)DelayInterp::InterpCubic;
         linkSeqToGrid = state.hasProperty("linkSeqToGrid") ? (bool)state.getProperty("linkSeqToGrid") : true;
         midiTriggerChn = (int)state.getProperty("midiTriggerChn");
 
         for (int i = 0; i < 12; ++i) {
-            patterns[i]->clear();
             patterns[i]->clearUndo();
 
-            auto str = state.getProperty("pattern" + String(i)).toString().toStdString();
-            if (!str.empty()) {
-                double x, y, tension;
-                int type;
-                std::istringstream iss(str);
-                while (iss >> x >> y >> tension >> type) {
-                    patterns[i]->insertPoint(x,y,tension,type, false);
-                }
-            }
-
             auto tension = (double)params.getRawParameterValue("tension")->load();
             auto tensionatk = (double)params.getRawParameterValue("tensionatk")->load();
             auto tensionrel = (double)params.getRawParameterValue("tensionrel")->load();
             patterns[i]->setTension(tension, tensionatk, tensionrel, dualTension);
-            patterns[i]->buildSegments();
+            patterns[i]->useTable = envQuality == EnvQuality::EnvTable;
+
+            auto str = state.getProperty("pattern" + String(i)).toString().toStdString();
+            patterns[i]->assignPoints(Pattern::parsePoints(str));
         }
 
         if (state.hasProperty("seqcells")) {
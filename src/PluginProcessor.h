@@ -20,22 +20,18 @@
 #include "Globals.h"
 #include "ui/Sequencer.h"
 #include "utils/PatternManager.h"
+#include "utils/MidiScheduler.h"
+#include "utils/SPSCQueue.h"
 
 using namespace globals;
 
 struct MidiInMsg {
-    int offset;
-    int isNoteon;
+    int offset; // sample position in the block
     int note;
     int vel;
     int channel;
 };
 
-struct MidiOutMsg {
-    MidiMessage msg;
-    int offset;
-};
-
 enum ANoise {
     ANOff,
     ANLow,
@@ -43,6 +39,11 @@ enum ANoise {
     ANLinear
 };
 
+enum EnvQuality {
+    EnvExact,
+    EnvTable
+};
+
 enum Trigger {
     Sync,
     MIDI,
@@ -59,6 +60,87 @@ struct TensionParameters {
         : tension(t), tensionAtk(ta), tensionRel(tr), dualTension(dual) {}
 };
 
+// audio path state stored at the host sample precision
+template <typename T>
+struct AudioLanes {
+    Delay<T> delay; // interleaved frames of every main channel
+    std::vector<T> latBuffer; // latency buffer, channels interleaved
+    std::vector<T> inBlock; // input frames of the current chunk, sized in prepareToPlay
+    std::vector<T> delayedBlock; // latency delayed frames of the current chunk, audio trigger only
+    std::vector<T> outFrame; // per sample scratch frames
+    std::vector<T> fadeFrame;
+};
+
+// parameter values read once per block by the audio thread
+struct ParamSnapshot {
+    double mix = 0.0;
+    int patsync = 0;
+    int trigger = -1;
+    int sync = -1;
+    double rate = 0.0;
+    double phase = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double smooth = -1.0;
+    double attack = -1.0;
+    double release = -1.0;
+    double tension = -10.0;
+    double tensionAtk = -10.0;
+    double tensionRel = -10.0;
+    int algo = 0;
+    double threshold = 0.0;
+    double sense = 0.0;
+    double lowcut = 0.0;
+    double highcut = 0.0;
+    double offset = 0.0;
+    bool dualSmooth = true; // instance setting, rebuilds the smoother like a parameter
+};
+
+// linear ramp of a parameter across the block, starting from its value in the previous block
+// a parameter that did not move has a zero delta and evaluates to its exact value
+struct ParamRamp {
+    double start;
+    double delta; // change per sample
+
+    ParamRamp(double from, double to, int numSamples)
+        : start(from), delta(numSamples > 0 ? (to - from) / numSamples : 0.0) {}
+
+    // ramp of a value that wraps at 1 taking the shortest way around, at() may leave 0..1
+    static ParamRamp cyclic(double from, double to, int numSamples)
+    {
+        double d = to - from;
+        return ParamRamp(from, from + d - std::round(d), numSamples);
+    }
+
+    // value at block sample i, the last sample of the block reaches the new value
+    double at(int i) const { return start + delta * (i + 1); }
+    bool active() const { return delta != 0.0; }
+};
+
+// groups of derived state, readParams() flags the groups whose inputs changed
+enum ParamDeps {
+    DepTrigger = 1 << 0, // latency and trigger flags
+    DepSync = 1 << 1, // sync length and delay size
+    DepRate = 1 << 2, // delay size when not synced
+    DepSmooth = 1 << 3, // smoother coefficients
+    DepTension = 1 << 4, // pattern segments
+    DepFilters = 1 << 5, // audio trigger filter coefficients
+    DepAll = 0xff
+};
+
+// notifications from the audio thread, handled on the message thread by timerCallback
+enum UIEventType {
+    UIPatternChanged, // audio pattern switched
+    UILatencyChanged, // showLatencyWarning changed
+    UIModeRequest, // value is the UIMode to set
+    UISyncChanged // sync changed between Rate Hz and a note length, updates the visible knobs
+};
+
+struct UIEvent {
+    UIEventType type;
+    int value;
+};
+
 enum PatSync {
     Off,
     QuarterBeat,
@@ -111,9 +193,9 @@ public:
 */
 class TIME12AudioProcessor  
     : public AudioProcessor
-    , public AudioProcessorParameter::Listener
     , public ChangeBroadcaster
     , private AudioProcessorValueTreeState::Listener
+    , private Timer
 {
 public:
     static constexpr int GRID_SIZES[] = {
@@ -140,6 +222,8 @@ public:
     int outputCCChan = 0; // output CC channel, 0 is channel 1
     int outputATMIDI = 0; // audio trigger midi note output, 0 is off, 60 is C4
     bool bipolarCC = false;
+    bool highResCC = false; // 14 bit CC, MSB on outputCC and LSB on outputCC + 32, CC 0..31 only
+    int outputCCRate = 0; // index in CC_RATE_MILLIS
     bool outputCV = false;
     int paintTool = 0; // index of pattern used for paint mode
     int paintPage = 0;
@@ -149,6 +233,13 @@ public:
     // State
     Pattern* pattern; // current pattern used for audio processing
     Pattern* viewPattern; // pattern being edited on the view, usually the audio pattern but can also be a paint mode pattern
+    const PatternSnapshot* patternSnapshot = nullptr; // compiled segments of the audio pattern pinned by the audio thread
+    std::atomic<bool> tensionDirty = false; // tension params changed, timerCallback rebuilds the patterns once per tick
+    int envCursor = -1; // last segment evaluated by getY
+    std::vector<double> envBuffer; // x then smoothed y of the current chunk, its size bounds the chunk length
+    std::vector<double> viewBuffer; // view position of the current chunk
+    std::vector<double> hitBuffer; // audio trigger hit amplitude of the current chunk, -1 when none
+    std::vector<double> monBlock; // latency delayed monitor frames of the current chunk
     Sequencer* sequencer;
     int queuedPattern = 0; // queued pat index, 0 = off
     int64_t queuedPatternCountdown = 0; // samples counter until queued pattern is applied
@@ -160,39 +251,38 @@ public:
     double trigposSinceHit = 1.0; // used by audioIgnoreHitsWhilePlaying option
     double trigphase = 0.0; // phase when trigger occurs, used to sync the background wave draw
     double syncQN = 1.0; // sync quarter notes
-    int ltrigger = -1; // last trigger mode
     bool midiTrigger = false; // flag midi has triggered envelope
     int winpos = 0;
     int lwinpos = 0;
-    int lsync = -1;
-    double ltension = -10.0;
-    double ltensionatk = -10.0;
-    double ltensionrel = -10.0;
     RCSmoother* value; // smooths envelope value
+    ParamSnapshot ps; // parameters of the current block, written by readParams()
+    ParamSnapshot lps; // parameters of the previous block, automation ramps start from these values
     bool showLatencyWarning = false;
 
     // Latency and delay state
-    Delay delayL;
-    Delay delayR;
+    AudioLanes<float> floatLanes; // allocated when the host processes in single precision
+    AudioLanes<double> doubleLanes; // allocated when the host processes in double precision
+    int delayMaxSize = 0; // longest delay in samples the preallocated lines hold, tempos below DELAY_MIN_TEMPO are clamped to it
+    int numChannels = 2; // main bus channels the engine was prepared for
+    int monChannels = 2; // channels allocated for transient detection, main or sidechain
     int ansamps = 0; // anti-noise nsamples for crossfade
     int xfade = 0; // cross fade sample counter
     double xfadepos = 0.0; // crossfade position
+    std::vector<double> fadeCurve; // crossfade weights indexed by remaining samples, built in buildFadeCurve
+    std::atomic<int> anoiseRequest = -1; // ANoise set from the message thread, fadeCurve is rebuilt from it on the next block
     int latency = 0; // samples
     int writepos = 0;
     int readpos = 0;
     ANoise anoise = ANoise::ANLow;
+    EnvQuality envQuality = EnvQuality::EnvExact; // envelope evaluation, exact or interpolated lookup tables
+    std::atomic<int> delayInterp = DelayInterp::InterpCubic; // DelayInterp read while the envelope moves, set from the message thread
 
     // Audio mode state
     bool audioTrigger = false; // flag audio has triggered envelope
     int audioTriggerCountdown = -1; // samples until audio envelope starts
-    std::vector<double> latBufferL; // latency buffer left
-    std::vector<double> latBufferR; // latency buffer right
-    std::vector<double> latMonitorBufferL; // latency monitor buffer left
-    std::vector<double> latMonitorBufferR; // latency monitor buffer right
-    Filter lpFilterL{};
-    Filter lpFilterR{};
-    Filter hpFilterL{};
-    Filter hpFilterR{};
+    std::vector<double> latMonitorBuffer; // latency monitor buffer, monChannels interleaved
+    std::vector<Filter> lpFilters; // one per monitor channel
+    std::vector<Filter> hpFilters; // one per monitor channel
     double hitamp = 0.0; // used to display transient hits on monitor view
 
     // PlayHead state
@@ -232,6 +322,9 @@ public:
     void parameterChanged (const juce::String& parameterID, float newValue) override;
 
     void setAntiNoise(ANoise mode);
+    void buildFadeCurve(ANoise mode);
+    void setEnvQuality(EnvQuality quality);
+    void timerCallback() override;
     void updateLatency(double sampleRate);
     void resizeDelays(double sampleRate, bool clear);
     void loadSettings();
@@ -245,6 +338,7 @@ public:
     void togglePaintEditMode();
     void togglePaintMode();
     void toggleSequencerMode();
+    Pattern* getAudioPattern(int index);
     Pattern* getPaintPatern(int index);
     void setViewPattern(int index);
     void setPaintTool(int index);
@@ -258,8 +352,6 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
-    void parameterValueChanged (int parameterIndex, float newValue) override;
-    void parameterGestureChanged (int parameterIndex, bool gestureIsStarting) override;
     bool supportsDoublePrecisionProcessing() const override;
 
    #ifndef JucePlugin_PreferredChannelConfigurations
@@ -267,7 +359,8 @@ public:
    #endif
 
     //==============================================================================
-    void onSlider ();
+    int readParams();
+    void onSlider (int changed = DepAll);
     void onTensionChange();
     void onPlay ();
     void onStop ();
@@ -285,6 +378,8 @@ public:
     void processBlock (AudioBuffer<float>&, MidiBuffer&) override;
     template <typename FloatType>
     void processBlockByType(AudioBuffer<FloatType>& buffer, MidiBuffer& midiMessages);
+    template <typename FloatType>
+    AudioLanes<FloatType>& getLanes();
 
     //==============================================================================
     AudioProcessorEditor* createEditor() override;
@@ -313,16 +408,42 @@ public:
 
     AudioProcessorValueTreeState params;
     UndoManager undoManager;
+    UndoBudget undoBudget { UNDO_BUDGET_BYTES }; // shared by the undo journals of all patterns and the sequencer
 
 private:
     Pattern* patterns[12]; // audio process patterns
     Pattern* paintPatterns[PAINT_PATS]; // paint mode patterns
-    Transient transDetectorL;
-    Transient transDetectorR;
-    bool paramChanged = false; // flag that triggers on any param change
+    std::vector<Transient> transDetectors; // one per monitor channel
+    std::vector<double> monFrame; // monitor scratch frame, sized in prepareToPlay
+    struct {
+        std::atomic<float>* mix;
+        std::atomic<float>* patsync;
+        std::atomic<float>* trigger;
+        std::atomic<float>* sync;
+        std::atomic<float>* rate;
+        std::atomic<float>* phase;
+        std::atomic<float>* min;
+        std::atomic<float>* max;
+        std::atomic<float>* smooth;
+        std::atomic<float>* attack;
+        std::atomic<float>* release;
+        std::atomic<float>* tension;
+        std::atomic<float>* tensionAtk;
+        std::atomic<float>* tensionRel;
+        std::atomic<float>* algo;
+        std::atomic<float>* threshold;
+        std::atomic<float>* sense;
+        std::atomic<float>* lowcut;
+        std::atomic<float>* highcut;
+        std::atomic<float>* offset;
+    } raw; // parameter values looked up once in the constructor, safe to load from any thread
     ApplicationProperties settings;
-    std::vector<MidiInMsg> midiIn; // midi buffer used to process midi messages offset
-    std::vector<MidiOutMsg> midiOut;
+    std::vector<MidiInMsg> midiIn; // note ons of the current block sorted by offset, capacity reserved in prepareToPlay
+    SPSCQueue<UIEvent, 64> uiEvents; // written by the audio callback or prepareToPlay, which never overlap
+    MidiScheduler<MIDI_OUT_CAPACITY> midiOut; // note offs of the audio trigger output
+    int64_t sampleClock = 0; // samples processed since construction, timeline of midiOut
+    int lastCC = -1; // last CC value sent, -1 forces the next one
+    int lastCCTarget = -1; // CC, channel and format of lastCC, a change resends the value
     PatternManager patternManager;
 
     //==============================================================================
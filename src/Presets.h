@@ -126,19 +126,6 @@ private:
 	}
 
 	static std::vector<PPoint> parsePreset(const std::string& str) {
-		std::vector<PPoint> result;
-		std::istringstream iss(str);
-		double x, y, tension;
-		int type;
-
-		if (str.empty()) {
-			return {};  // Return empty array if the string is empty
-		}
-
-		while (iss >> x >> y >> tension >> type) {
-			result.emplace_back(PPoint{0, x, y, tension, type});
-		}
-
-		return result;
+		return Pattern::parsePoints(str);
 	}
 };
\ No newline at end of file
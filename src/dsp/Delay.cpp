@@ -1,78 +1,359 @@
 #include "Delay.h"
 #include <cmath>
+#include <algorithm>
 
-void Delay::resize(int newSize, bool clear)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DELAY_SSE2 1
+#endif
+
+static constexpr int SINC_WIDTH = 16; // kernel taps, matches Delay::SINC_TAPS
+static constexpr int SINC_PHASES = 256; // fractional positions per tap, rows are interpolated
+static constexpr int SINC_BANKS = 4; // cutoffs for read head speeds up to 1x, 2x, 3x and 4x
+
+/*
+  Blackman windowed sinc kernels built once at load time,
+  bank b lowers the cutoff to 0.9 / (b + 1) of nyquist and every row sums to one
+*/
+struct SincTable {
+    float taps[SINC_BANKS][SINC_PHASES + 1][SINC_WIDTH];
+
+    SincTable()
+    {
+        const double pi = 3.14159265358979323846;
+        const double half = SINC_WIDTH / 2;
+        for (int b = 0; b < SINC_BANKS; ++b) {
+            double cutoff = 0.9 / (b + 1);
+            for (int p = 0; p <= SINC_PHASES; ++p) {
+                double frac = (double)p / SINC_PHASES;
+                double row[SINC_WIDTH];
+                double sum = 0.0;
+                for (int t = 0; t < SINC_WIDTH; ++t) {
+                    double x = (t - (half - 1)) - frac; // distance from the read position
+                    double sinc = x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+                    double window = std::fabs(x) >= half ? 0.0
+                        : 0.42 + 0.5 * std::cos(pi * x / half) + 0.08 * std::cos(2 * pi * x / half);
+                    row[t] = sinc * window;
+                    sum += row[t];
+                }
+                for (int t = 0; t < SINC_WIDTH; ++t)
+                    taps[b][p][t] = (float)(row[t] / sum);
+            }
+        }
+    }
+};
+
+static const SincTable sincTable;
+
+template <typename T>
+void Delay<T>::setChannels(int numChannels)
+{
+    channels = numChannels;
+    curval.assign(channels, T(0));
+    std::vector<T>().swap(buf);
+    capacity = 0;
+    mask = 0;
+    curpos = 0;
+    if (size > 0)
+        grow(size);
+}
+
+/*
+  Frees the buffer, used for the precision the host is not processing with
+*/
+template <typename T>
+void Delay<T>::release()
 {
+    channels = 0;
+    std::vector<T>().swap(buf);
+    std::vector<T>().swap(curval);
+    capacity = 0;
+    mask = 0;
+    curpos = 0;
+}
+
+/*
+  Changes the logical size without allocating,
+  sizes past the reserved capacity are clamped to it.
+  Growing zeroes the frames the longer size exposes, they hold audio
+  older than the previous reach or left over from before the last clear
+*/
+template <typename T>
+void Delay<T>::resize(int newSize, bool clear)
+{
+    newSize = std::min(newSize, maxSize());
     if (clear) {
-        if (newSize > size) {
-            buf.resize(newSize, 0.0);
-        }
         curpos = 0;
-        curval = 0;
-    }
-    else {
-        if (newSize > size) {
-            buf.resize(newSize);
-            std::fill(buf.begin() + size, buf.end(), 0.0);
-        }
-        curpos %= newSize;
+        std::fill(curval.begin(), curval.end(), T(0));
     }
+    if (newSize > size)
+        zeroBehind(size + GUARD, newSize + GUARD);
     size = newSize;
 }
 
-void Delay::reserve(int samples)
+/*
+  Preallocates room for samples frames while keeping the buffer under maxBytes,
+  returns the largest size the delay can now take
+*/
+template <typename T>
+int Delay<T>::reserve(int samples, size_t maxBytes)
 {
-    buf.reserve(samples);
+    int newCapacity = 1;
+    while (newCapacity < samples + GUARD)
+        newCapacity <<= 1;
+    const size_t frameBytes = (size_t)channels * sizeof(T);
+    while (newCapacity > 1 && (size_t)(newCapacity + GUARD) * frameBytes > maxBytes)
+        newCapacity >>= 1;
+
+    if (newCapacity > capacity)
+        grow(newCapacity - GUARD);
+    size = std::min(size, maxSize());
+    return maxSize();
 }
 
-void Delay::clear()
+/*
+  Reallocates to the next power of two that fits samples plus the guard
+  keeping the written history in place relative to the write position
+*/
+template <typename T>
+void Delay<T>::grow(int samples)
 {
-    std::fill(buf.begin(), buf.end(), 0.0);
+    int newCapacity = 1;
+    while (newCapacity < samples + GUARD)
+        newCapacity <<= 1;
+
+    std::vector<T> newBuf((size_t)(newCapacity + GUARD) * channels, T(0));
+    int newMask = newCapacity - 1;
+    for (int k = 1; k <= capacity; ++k) {
+        std::copy_n(buf.begin() + (size_t)((curpos - k) & mask) * channels, channels,
+            newBuf.begin() + (size_t)((curpos - k) & newMask) * channels);
+    }
+    std::copy_n(newBuf.begin(), GUARD * channels, newBuf.begin() + (size_t)newCapacity * channels);
+
+    buf.swap(newBuf);
+    capacity = newCapacity;
+    mask = newMask;
+    if ((int)curval.size() != channels)
+        curval.assign(channels, T(0));
 }
 
-void Delay::write(double s)
+/*
+  Silences the frames reads can reach, size plus the guard behind the write position
+  and the guard ahead of it, frames further back are zeroed by resize if the size grows
+*/
+template <typename T>
+void Delay<T>::clear()
 {
-    buf[curpos] = s;
-    curpos += 1;
-    if (curpos == size)
-        curpos = 0;
+    if (capacity == 0)
+        return;
+    curpos = 0;
+    std::fill_n(buf.begin(), (size_t)GUARD * channels, T(0));
+    zeroBehind(0, size + GUARD);
 }
 
-double Delay::read(double delay)
+/*
+  Zeroes the frames 'from' to 'to' behind the write position and refreshes the mirror
+*/
+template <typename T>
+void Delay<T>::zeroBehind(int from, int to)
 {
-    if (delay >= size) return curval;
-    double pos = (double)curpos - delay;
-    if (pos < 0) {
-        pos += (double)size;
-        if (pos == size) { // avoids error with floating point arithmetics
-            pos = 0;
-        }
-    }
-    curval = buf[int(pos)];
-    return curval;
+    to = std::min(to, capacity);
+    if (from >= to)
+        return;
+    int start = (curpos - to) & mask; // oldest frame of the range
+    int count = to - from;
+    int first = std::min(count, capacity - start);
+    std::fill_n(buf.begin() + (size_t)start * channels, (size_t)first * channels, T(0));
+    std::fill_n(buf.begin(), (size_t)(count - first) * channels, T(0)); // wrapped part
+    std::copy_n(buf.begin(), (size_t)GUARD * channels, buf.begin() + (size_t)capacity * channels);
 }
+
+template <typename T>
+void Delay<T>::write(const T* frame)
+{
+    T* dst = buf.data() + (size_t)curpos * channels;
+    std::copy_n(frame, channels, dst);
+    if (curpos < GUARD)
+        std::copy_n(frame, channels, dst + (size_t)capacity * channels);
+    curpos = (curpos + 1) & mask;
+}
+
 /*
-  Interpolated delay read
+  Finds the taps around a read position, returns the first frame 'before' frames
+  ahead of the integer position, or nullptr when the delay exceeds the size
+  in which case the last frame read was copied instead
 */
-double Delay::read3(double delay)
+template <typename T>
+const T* Delay<T>::locate(double delay, T* frame, int before, double& frac)
 {
-    if (delay >= size) return curval;
-    double pos = (double)curpos - delay;
-    if (pos < 0) {
-        pos += (double)size;
-        if (pos == size) pos = 0; // avoids error with floating point arithmetics
+    if (delay >= size) {
+        std::copy_n(curval.data(), channels, frame);
+        return nullptr;
     }
+    double pos = (double)(curpos + capacity) - delay; // always positive, delay < size < capacity
     int i = (int)pos;
-    double f = pos - i;
-    double x0, x1, x2, x3, a0, a1, a2, a3;
-    x0 = i == 0 ? buf[size - 1] : buf[(i - 1)];
-    x1 = buf[i];
-    x2 = i == size - 1 ? buf[0] : buf[i + 1];
-    x3 = i >= size - 2 ? buf[i - size + 2] : buf[i + 2];
+    frac = pos - i;
+    return buf.data() + (size_t)((i - before) & mask) * channels; // contiguous frames thanks to the guard
+}
+
+template <typename T>
+void Delay<T>::applyTaps(const T* x, const double* w, int taps, T* frame)
+{
+    const int c = channels;
+    for (int ch = 0; ch < c; ++ch) {
+        T acc = T(0);
+        for (int t = 0; t < taps; ++t)
+            acc += (T)w[t] * x[t * c + ch];
+        curval[ch] = acc;
+        frame[ch] = acc;
+    }
+}
+
+template <typename T>
+void Delay<T>::read(double delay, T* frame, DelayInterp interp, double speed)
+{
+    switch (interp) {
+        case InterpNearest: read(delay, frame); break;
+        case InterpLinear: readLinear(delay, frame); break;
+        case InterpLagrange6: readLagrange6(delay, frame); break;
+        case InterpSinc: readSinc(delay, frame, speed); break;
+        default: read3(delay, frame); break;
+    }
+}
+
+template <typename T>
+void Delay<T>::read(double delay, T* frame)
+{
+    if (delay < size) {
+        double pos = (double)(curpos + capacity) - delay; // always positive, delay < size < capacity
+        std::copy_n(buf.data() + (size_t)((int)pos & mask) * channels, channels, curval.data());
+    }
+    std::copy_n(curval.data(), channels, frame);
+}
+
+#ifdef DELAY_SSE2
+// stereo frames fit one register, four frames of floats in two
+static inline void cubicStereo(const double* x, const double* a, double* y)
+{
+    __m128d v = _mm_mul_pd(_mm_set1_pd(a[0]), _mm_loadu_pd(x));
+    v = _mm_add_pd(v, _mm_mul_pd(_mm_set1_pd(a[1]), _mm_loadu_pd(x + 2)));
+    v = _mm_add_pd(v, _mm_mul_pd(_mm_set1_pd(a[2]), _mm_loadu_pd(x + 4)));
+    v = _mm_add_pd(v, _mm_mul_pd(_mm_set1_pd(a[3]), _mm_loadu_pd(x + 6)));
+    _mm_storeu_pd(y, v);
+}
+
+static inline void cubicStereo(const float* x, const double* a, float* y)
+{
+    __m128 w01 = _mm_setr_ps((float)a[0], (float)a[0], (float)a[1], (float)a[1]);
+    __m128 w23 = _mm_setr_ps((float)a[2], (float)a[2], (float)a[3], (float)a[3]);
+    __m128 v = _mm_add_ps(_mm_mul_ps(w01, _mm_loadu_ps(x)), _mm_mul_ps(w23, _mm_loadu_ps(x + 4)));
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    _mm_storel_pi((__m64*)y, v);
+}
+#endif
+
+/*
+  Interpolated delay read
+*/
+template <typename T>
+void Delay<T>::read3(double delay, T* frame)
+{
+    double f;
+    const T* x = locate(delay, frame, 1, f);
+    if (!x)
+        return;
+    double a0, a1, a2, a3;
     a3 = f * f; a3 -= 1.0; a3 *= (1.0 / 6.0);
     a2 = (f + 1.0) * 0.5; a0 = a2 - 1.0;
     a1 = a3 * 3.0; a2 -= a1; a0 -= a3; a1 -= f;
     a0 *= f; a1 *= f; a2 *= f; a3 *= f; a1 += 1.0;
-    curval = a0 * x0 + a1 * x1 + a2 * x2 + a3 * x3;
-    return curval;
-}
\ No newline at end of file
+
+#ifdef DELAY_SSE2
+    if (channels == 2) {
+        const double a[4] = { a0, a1, a2, a3 };
+        cubicStereo(x, a, curval.data());
+        frame[0] = curval[0];
+        frame[1] = curval[1];
+        return;
+    }
+#endif
+
+    const int c = channels;
+    const T w0 = (T)a0, w1 = (T)a1, w2 = (T)a2, w3 = (T)a3;
+    for (int ch = 0; ch < c; ++ch) {
+        curval[ch] = w0 * x[ch] + w1 * x[c + ch] + w2 * x[2 * c + ch] + w3 * x[3 * c + ch];
+        frame[ch] = curval[ch];
+    }
+}
+
+template <typename T>
+void Delay<T>::readLinear(double delay, T* frame)
+{
+    double f;
+    const T* x = locate(delay, frame, 0, f);
+    if (!x)
+        return;
+    const double w[2] = { 1.0 - f, f };
+    applyTaps(x, w, 2, frame);
+}
+
+/*
+  6-point Lagrange over taps i - 2 to i + 3,
+  numerators from prefix and suffix products of (f - node)
+*/
+template <typename T>
+void Delay<T>::readLagrange6(double delay, T* frame)
+{
+    if (delay <= 3.0) { // tap i + 3 would be ahead of the write head
+        readLinear(delay, frame);
+        return;
+    }
+    double f;
+    const T* x = locate(delay, frame, 2, f);
+    if (!x)
+        return;
+    static const double denom[6] = { -120.0, 24.0, -12.0, 12.0, -24.0, 120.0 };
+    double d[6], pre[6], suf[6], w[6];
+    for (int k = 0; k < 6; ++k)
+        d[k] = f - (k - 2);
+    pre[0] = 1.0;
+    for (int k = 1; k < 6; ++k)
+        pre[k] = pre[k - 1] * d[k - 1];
+    suf[5] = 1.0;
+    for (int k = 4; k >= 0; --k)
+        suf[k] = suf[k + 1] * d[k + 1];
+    for (int k = 0; k < 6; ++k)
+        w[k] = pre[k] * suf[k] / denom[k];
+    applyTaps(x, w, 6, frame);
+}
+
+/*
+  Polyphase windowed sinc, the bank is picked from the read head speed
+  so sweeps faster than real time are band limited before they fold back
+*/
+template <typename T>
+void Delay<T>::readSinc(double delay, T* frame, double speed)
+{
+    static_assert(SINC_TAPS == SINC_WIDTH, "sinc table width");
+    if (delay <= SINC_TAPS / 2) { // tap i + 8 would be ahead of the write head
+        readLinear(delay, frame);
+        return;
+    }
+    double f;
+    const T* x = locate(delay, frame, SINC_TAPS / 2 - 1, f);
+    if (!x)
+        return;
+    int bank = std::clamp((int)std::ceil(speed) - 1, 0, SINC_BANKS - 1);
+    double p = f * SINC_PHASES;
+    int ip = std::min((int)p, SINC_PHASES - 1);
+    double pf = p - ip;
+    const float* r0 = sincTable.taps[bank][ip];
+    const float* r1 = sincTable.taps[bank][ip + 1];
+    double w[SINC_TAPS];
+    for (int t = 0; t < SINC_TAPS; ++t)
+        w[t] = r0[t] + (r1[t] - r0[t]) * pf;
+    applyTaps(x, w, SINC_TAPS, frame);
+}
+
+template class Delay<float>;
+template class Delay<double>;
@@ -1,18 +1,67 @@
 #pragma once
 #include <vector>
+#include <algorithm>
+#include <cstddef>
 
+/*
+	Interpolation used while the read head moves, cost in multiply-adds per channel per sample
+	InterpNearest    0, truncates the position, zippers and aliases on sweeps
+	InterpLinear     2, cheap, dulls the highs on fractional positions
+	InterpCubic      4, 4-point Lagrange, the default
+	InterpLagrange6  6, 6-point Lagrange, flatter passband for slow sweeps
+	InterpSinc      32, 16-tap polyphase windowed sinc with two interpolated phases,
+	                    the cutoff drops with the head speed so fast sweeps do not alias
+	Lagrange6 and sinc fall back to linear when their taps would reach past the write head
+*/
+enum DelayInterp {
+	InterpNearest,
+	InterpLinear,
+	InterpCubic,
+	InterpLagrange6,
+	InterpSinc
+};
+
+/*
+	Multichannel delay line over a power of two ring buffer of interleaved frames
+	The logical size follows tempo and sync while the physical capacity only grows,
+	the first GUARD frames are mirrored past the end so interpolated reads never wrap.
+	Read positions and interpolation weights are computed once per frame for all channels.
+	Memory is only allocated by setChannels and reserve, resize changes the logical size
+	within the reserved capacity so it is safe to call from the audio thread.
+	Samples are stored as T, float for single precision hosts and double otherwise,
+	positions stay double so long delays keep their fractional accuracy
+*/
+template <typename T>
 class Delay {
 public:
+	void setChannels(int channels);
+	void release();
 	void resize(int size, bool clear);
-	void write(double s);
-	double read(double delay);
-	double read3(double delay);
+	void write(const T* frame);
+	void read(double delay, T* frame);
+	void read3(double delay, T* frame);
+	void read(double delay, T* frame, DelayInterp interp, double speed);
 	void clear();
-	void reserve(int samples);
-	int size = 0;
+	int reserve(int samples, size_t maxBytes);
+	int maxSize() const { return std::max(0, capacity - GUARD); }
+	size_t bytes() const { return buf.size() * sizeof(T); }
+	int size = 0; // logical length in frames
+	int channels = 0; // zero until prepared, an unprepared delay holds no memory
 
 private:
-	std::vector<double> buf;
+	static constexpr int SINC_TAPS = 16;
+	static constexpr int GUARD = SINC_TAPS - 1; // mirrored frames, the widest kernel reads taps i - 7 to i + 8
+	std::vector<T> buf; // (capacity + GUARD) * channels
+	std::vector<T> curval; // last frame read, returned when the delay exceeds the size
+	int capacity = 0;
+	int mask = 0;
 	int curpos = 0;
-	double curval = 0.0;
-};
\ No newline at end of file
+
+	void grow(int samples);
+	void zeroBehind(int from, int to);
+	const T* locate(double delay, T* frame, int before, double& frac);
+	void readLinear(double delay, T* frame);
+	void readLagrange6(double delay, T* frame);
+	void readSinc(double delay, T* frame, double speed);
+	void applyTaps(const T* x, const double* w, int taps, T* frame);
+};
@@ -9,15 +9,155 @@
 
 #include "Pattern.h"
 #include <cmath>
+#include <cstring>
+#include <sstream>
 #include <algorithm>
 #include "../PluginProcessor.h"
+#include "../utils/RTAudit.h"
 
 std::vector<PPoint> Pattern::copy_pattern;
 
-Pattern::Pattern(int i)
+/*
+  Fast pow and cos used by the block kernels, abs error below 1e-11 on the envelope range
+  Integer parts are extracted by adding 1.5 * 2^52 and reading the low mantissa bits
+  so both the scalar and the SSE2 versions run the same branch free steps
+*/
+static constexpr double ROUND_MAGIC = 6755399441055744.0; // 1.5 * 2^52
+static constexpr double LOG2_MIN = -1020.0; // smaller powers flush to zero
+
+static inline double bitsToDouble(uint64_t b) { double d; std::memcpy(&d, &b, sizeof d); return d; }
+static inline uint64_t doubleToBits(double d) { uint64_t b; std::memcpy(&b, &d, sizeof b); return b; }
+
+// u^p for u in [0, 1] and p > 0
+static inline double fastPow(double u, double p)
+{
+    // log2(u) = e + log2(m) with m in [sqrt(1/2), sqrt(2)), log(m) = 2 atanh(s)
+    uint64_t bits = doubleToBits(std::max(u, 1e-300));
+    double e = bitsToDouble(0x4330000000000000ULL | (bits >> 52)) - 4503599627370496.0 - 1023.0;
+    double m = bitsToDouble((bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL);
+    if (m > 1.4142135623730951) {
+        m *= 0.5;
+        e += 1.0;
+    }
+    double s = (m - 1.0) / (m + 1.0);
+    double s2 = s * s;
+    double y = p * (e + s * (2.8853900817779268 + s2 * (0.9617966939259756 + s2 * (0.5770780163555854
+        + s2 * (0.4121985831111324 + s2 * (0.3205988979753252 + s2 * (0.2623081892525388 + s2 * 0.2219530832137636)))))));
+    if (y < LOG2_MIN)
+        return 0.0;
+
+    // 2^y = 2^k * exp(f ln2)
+    double k = (y + ROUND_MAGIC) - ROUND_MAGIC;
+    double f = (y - k) * 0.6931471805599453;
+    double r = 1.0 + f * (1.0 + f * (1.0/2 + f * (1.0/6 + f * (1.0/24 + f * (1.0/120
+        + f * (1.0/720 + f * (1.0/5040 + f * (1.0/40320 + f * (1.0/362880 + f * (1.0/3628800))))))))));
+    return r * bitsToDouble((doubleToBits(k + ROUND_MAGIC) + 1023) << 52);
+}
+
+// cos(a) for |a| up to a few thousand radians
+static inline double fastCos(double a)
+{
+    // cos(r + k pi) = (-1)^k cos(r) with r in [-pi/2, pi/2]
+    double k = (a * 0.3183098861837907 + ROUND_MAGIC) - ROUND_MAGIC;
+    double r = a - k * 3.141592653589793 - k * 1.2246467991473532e-16;
+    double r2 = r * r;
+    double c = 1.0 + r2 * (-1.0/2 + r2 * (1.0/24 + r2 * (-1.0/720 + r2 * (1.0/40320 + r2 * (-1.0/3628800
+        + r2 * (1.0/479001600 + r2 * (-1.0/87178291200.0 + r2 * (1.0/20922789888000.0))))))));
+    return bitsToDouble(doubleToBits(c) ^ (doubleToBits(k + ROUND_MAGIC) << 63));
+}
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PATTERN_SSE2 1
+
+static inline __m128d fastPow(__m128d u, __m128d p)
+{
+    __m128i bits = _mm_castpd_si128(_mm_max_pd(u, _mm_set1_pd(1e-300)));
+    __m128d e = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits, 52), _mm_set1_epi64x(0x4330000000000000LL))),
+        _mm_set1_pd(4503599627370496.0 + 1023.0));
+    __m128d m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi64x(0x000FFFFFFFFFFFFFLL)),
+        _mm_set1_epi64x(0x3FF0000000000000LL)));
+    __m128d high = _mm_cmpgt_pd(m, _mm_set1_pd(1.4142135623730951));
+    m = _mm_mul_pd(m, _mm_sub_pd(_mm_set1_pd(1.0), _mm_and_pd(high, _mm_set1_pd(0.5))));
+    e = _mm_add_pd(e, _mm_and_pd(high, _mm_set1_pd(1.0)));
+    __m128d s = _mm_div_pd(_mm_sub_pd(m, _mm_set1_pd(1.0)), _mm_add_pd(m, _mm_set1_pd(1.0)));
+    __m128d s2 = _mm_mul_pd(s, s);
+    __m128d l = _mm_set1_pd(0.2219530832137636);
+    l = _mm_add_pd(_mm_mul_pd(l, s2), _mm_set1_pd(0.2623081892525388));
+    l = _mm_add_pd(_mm_mul_pd(l, s2), _mm_set1_pd(0.3205988979753252));
+    l = _mm_add_pd(_mm_mul_pd(l, s2), _mm_set1_pd(0.4121985831111324));
+    l = _mm_add_pd(_mm_mul_pd(l, s2), _mm_set1_pd(0.5770780163555854));
+    l = _mm_add_pd(_mm_mul_pd(l, s2), _mm_set1_pd(0.9617966939259756));
+    l = _mm_add_pd(_mm_mul_pd(l, s2), _mm_set1_pd(2.8853900817779268));
+    __m128d y = _mm_mul_pd(p, _mm_add_pd(e, _mm_mul_pd(s, l)));
+    __m128d live = _mm_cmpge_pd(y, _mm_set1_pd(LOG2_MIN));
+    y = _mm_max_pd(y, _mm_set1_pd(LOG2_MIN));
+
+    __m128d kr = _mm_add_pd(y, _mm_set1_pd(ROUND_MAGIC));
+    __m128d k = _mm_sub_pd(kr, _mm_set1_pd(ROUND_MAGIC));
+    __m128d f = _mm_mul_pd(_mm_sub_pd(y, k), _mm_set1_pd(0.6931471805599453));
+    __m128d r = _mm_set1_pd(1.0/3628800);
+    const double coeffs[] = { 1.0/362880, 1.0/40320, 1.0/5040, 1.0/720, 1.0/120, 1.0/24, 1.0/6, 1.0/2, 1.0, 1.0 };
+    for (double c : coeffs)
+        r = _mm_add_pd(_mm_mul_pd(r, f), _mm_set1_pd(c));
+    __m128d scale = _mm_castsi128_pd(_mm_slli_epi64(_mm_add_epi64(_mm_castpd_si128(kr), _mm_set1_epi64x(1023)), 52));
+    return _mm_and_pd(live, _mm_mul_pd(r, scale));
+}
+
+static inline __m128d fastCos(__m128d a)
+{
+    __m128d kr = _mm_add_pd(_mm_mul_pd(a, _mm_set1_pd(0.3183098861837907)), _mm_set1_pd(ROUND_MAGIC));
+    __m128d k = _mm_sub_pd(kr, _mm_set1_pd(ROUND_MAGIC));
+    __m128d r = _mm_sub_pd(_mm_sub_pd(a, _mm_mul_pd(k, _mm_set1_pd(3.141592653589793))),
+        _mm_mul_pd(k, _mm_set1_pd(1.2246467991473532e-16)));
+    __m128d r2 = _mm_mul_pd(r, r);
+    __m128d c = _mm_set1_pd(1.0/20922789888000.0);
+    const double coeffs[] = { -1.0/87178291200.0, 1.0/479001600, -1.0/3628800, 1.0/40320, -1.0/720, 1.0/24, -1.0/2, 1.0 };
+    for (double co : coeffs)
+        c = _mm_add_pd(_mm_mul_pd(c, r2), _mm_set1_pd(co));
+    return _mm_xor_pd(c, _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(kr), 63)));
+}
+#endif
+
+// in place u^p over a block, u in [0, 1]
+static void powBlock(double* u, double p, int n)
+{
+    int i = 0;
+#ifdef PATTERN_SSE2
+    __m128d pp = _mm_set1_pd(p);
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(u + i, fastPow(_mm_loadu_pd(u + i), pp));
+#endif
+    for (; i < n; ++i)
+        u[i] = fastPow(u[i], p);
+}
+
+// in place cos over a block
+static void cosBlock(double* a, int n)
+{
+    int i = 0;
+#ifdef PATTERN_SSE2
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(a + i, fastCos(_mm_loadu_pd(a + i)));
+#endif
+    for (; i < n; ++i)
+        a[i] = fastCos(a[i]);
+}
+
+Pattern::Pattern(int i, UndoBudget& undoBudget)
+    : undoStack(globals::MAX_UNDO, undoBudget)
+    , redoStack(globals::MAX_UNDO, undoBudget)
 {
     index = i;
     incrementVersion();
+    snapshot.store(new PatternSnapshot());
+}
+
+Pattern::~Pattern()
+{
+    for (auto* snap : retired)
+        delete snap;
+    delete snapshot.load();
 }
 
 void Pattern::incrementVersion()
@@ -35,7 +175,7 @@ void Pattern::sortPoints()
 
 void Pattern::sortPointsSafe()
 {
-    std::lock_guard<std::mutex> lock(pointsmtx);
+    RTAudit::Lock lock(pointsmtx);
     std::sort(points.begin(), points.end(), [](const PPoint& a, const PPoint& b) {
         return a.x < b.x;
     });
@@ -49,19 +189,25 @@ void Pattern::setTension(double t, double tatk, double trel, bool dual)
     tensionMult.store(t);
 }
 
+/*
+  Inserts the point at its sorted position after any points with the same x
+  so the order of vertical edges is kept, returns the point index
+*/
 int Pattern::insertPoint(double x, double y, double tension, int type, bool sort)
 {
     auto id = pointsIDCounter;
     pointsIDCounter += 1;
 
     const PPoint p = { id, x, y, tension, type };
-    points.push_back(p);
-    if (sort)
-        sortPoints();
+    if (!sort) {
+        points.push_back(p);
+        return (int)points.size() - 1;
+    }
 
-    // return point index
-    auto pidx = std::find_if(points.begin(), points.end(), [id](const PPoint& p) { return p.id == id; });
-    return pidx == points.end() ? -1 : (int)std::distance(points.begin(), pidx);
+    auto it = std::upper_bound(points.begin(), points.end(), x, [](double x, const PPoint& p) {
+        return x < p.x;
+    });
+    return (int)std::distance(points.begin(), points.insert(it, p));
 };
 
 void Pattern::removePoint(double x, double y)
@@ -80,13 +226,92 @@ void Pattern::removePoint(int i) {
 
 void Pattern::removePointsInRange(double x1, double x2)
 {
-    for (auto i = points.begin(); i != points.end(); ++i) {
-        if (i->x >= x1 && i->x <= x2) {
-            i = points.erase(i);
-            removePointsInRange(x1, x2);
-            return;
-        }
+    points.erase(std::remove_if(points.begin(), points.end(), [x1, x2](const PPoint& p) {
+        return p.x >= x1 && p.x <= x2;
+    }), points.end());
+}
+
+/*
+  Removes the points in [x1, x2] and merges in pts with new ids in a single pass
+  pts keep their relative order where x is equal, points must be sorted
+*/
+void Pattern::replacePointsInRange(double x1, double x2, std::vector<PPoint> pts)
+{
+    removePointsInRange(x1, x2);
+    for (auto& p : pts) {
+        p.id = pointsIDCounter;
+        pointsIDCounter += 1;
+    }
+    std::stable_sort(pts.begin(), pts.end(), [](const PPoint& a, const PPoint& b) {
+        return a.x < b.x;
+    });
+
+    auto mid = points.insert(points.end(), pts.begin(), pts.end());
+    std::inplace_merge(points.begin(), mid, points.end(), [](const PPoint& a, const PPoint& b) {
+        return a.x < b.x;
+    });
+}
+
+/*
+  Replaces all points in one step, used by state restore, presets and imports
+  Drops non finite points, clamps the rest to the valid ranges, sorts once,
+  assigns ids and builds the segments, so tension must be set beforehand
+*/
+void Pattern::assignPoints(const std::vector<PPoint>& pts)
+{
+    std::vector<PPoint> valid;
+    valid.reserve(pts.size());
+    for (auto p : pts) {
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.tension))
+            continue;
+        p.id = pointsIDCounter;
+        pointsIDCounter += 1;
+        p.x = std::clamp(p.x, 0.0, 1.0);
+        p.y = std::clamp(p.y, 0.0, 1.0);
+        p.tension = std::clamp(p.tension, -1.0, 1.0);
+        p.type = std::clamp(p.type, (int)PointType::Hold, (int)PointType::HalfSine);
+        valid.push_back(p);
+    }
+    std::stable_sort(valid.begin(), valid.end(), [](const PPoint& a, const PPoint& b) {
+        return a.x < b.x;
+    });
+
+    {
+        RTAudit::Lock lock(pointsmtx);
+        points.swap(valid);
     }
+    incrementVersion();
+    buildSegments();
+}
+
+std::vector<PPoint> Pattern::parsePoints(const std::string& str)
+{
+    std::vector<PPoint> result;
+    std::istringstream iss(str);
+    double x, y, tension;
+    int type;
+    while (iss >> x >> y >> tension >> type) {
+        result.push_back({0, x, y, tension, type});
+    }
+    return result;
+}
+
+/*
+  Finds a point index by id through a cached id to index map
+  The UI reorders points directly, so a stale hit rebuilds the map once
+*/
+int Pattern::getPointIndex(uint64_t id)
+{
+    auto it = pointIndex.find(id);
+    if (it != pointIndex.end() && it->second < (int)points.size() && points[it->second].id == id)
+        return it->second;
+
+    pointIndex.clear();
+    for (int i = 0; i < (int)points.size(); ++i)
+        pointIndex[points[i].id] = i;
+
+    it = pointIndex.find(id);
+    return it == pointIndex.end() ? -1 : it->second;
 }
 
 void Pattern::invert()
@@ -148,16 +373,30 @@ void Pattern::doublePattern()
 
 void Pattern::clear()
 {
-    std::lock_guard<std::mutex> lock(pointsmtx);
+    RTAudit::Lock lock(pointsmtx);
     points.clear();
     incrementVersion();
 }
 
+static bool samePoint(const PPoint& a, const PPoint& b)
+{
+    return a.x == b.x && a.y == b.y && a.tension == b.tension && a.type == b.type;
+}
+
+/*
+    Rebuilds the span of segments between the points left unchanged at both ends,
+    found by comparing against the points the published snapshot was built from.
+    Edits write points from many places (view, multiselect, paint tool, sequencer)
+    so the dirty range is measured here rather than marked at every edit site.
+    Segments outside the range are copied with their compiled state and table nodes,
+    a change in the tension multipliers rebuilds everything
+*/
 void Pattern::buildSegments()
 {
+    RTAudit::Lock build(buildmtx);
     std::vector<PPoint> pts;
     {
-        std::lock_guard<std::mutex> lock(pointsmtx);
+        RTAudit::Lock lock(pointsmtx);
         pts = points;
     }
     // add ghost points outside the 0..1 boundary
@@ -177,21 +416,107 @@ void Pattern::buildSegments()
         pts.push_back({0, p1.x + 1.0, p1.y, p1.tension, p1.type});
     }
 
-    std::lock_guard<std::mutex> lock(mtx); // prevents crash while reading Y from another thread
-    segments.clear();
-    for (size_t i = 0; i < pts.size() - 1; ++i) {
+    auto* snap = new PatternSnapshot();
+    snap->tensionMult = tensionMult.load();
+    snap->tensionAtk = tensionAtk.load();
+    snap->tensionRel = tensionRel.load();
+    snap->dualTension = dualTension;
+
+    // only this thread publishes while buildmtx is held, so prev stays alive without mtx
+    const PatternSnapshot& prev = *snapshot.load();
+    const int oldCount = (int)builtPoints.size();
+    const int newCount = (int)pts.size();
+    int head = 0; // unchanged leading points
+    int tail = 0; // unchanged trailing points
+    if (prev.tensionMult == snap->tensionMult && prev.tensionAtk == snap->tensionAtk
+        && prev.tensionRel == snap->tensionRel && prev.dualTension == snap->dualTension
+        && oldCount > 1 && (int)prev.segments.size() == oldCount - 1)
+    {
+        const int common = std::min(oldCount, newCount);
+        while (head < common && samePoint(builtPoints[head], pts[head]))
+            head += 1;
+        while (tail < common - head && samePoint(builtPoints[oldCount - 1 - tail], pts[newCount - 1 - tail]))
+            tail += 1;
+    }
+
+    // segment i joins points i and i + 1, so it is clean when both ends are
+    const int count = newCount - 1;
+    const int lead = std::min(std::max(head - 1, 0), count);
+    const int trail = std::min(std::max(tail - 1, 0), count - lead);
+    auto& segments = snap->segments;
+    segments.reserve(count);
+    segments.insert(segments.end(), prev.segments.begin(), prev.segments.begin() + lead);
+    for (int i = lead; i < count - trail; ++i) {
         auto p1 = pts[i];
         auto p2 = pts[i + 1];
         segments.push_back({p1.x, p2.x, p1.y, p2.y, p1.tension, 0, p1.type});
+        compileSegment(segments.back());
+    }
+    segments.insert(segments.end(), prev.segments.end() - trail, prev.segments.end());
+
+    // copied segments still point at the previous table, their nodes are copied by compileTable
+    std::vector<int> lutOffsets(count, -1);
+    for (int i = 0; i < count; ++i) {
+        auto& seg = segments[i];
+        if (!seg.lut)
+            continue;
+        if (useTable)
+            lutOffsets[i] = static_cast<int>(seg.lut - prev.table.data());
+        else
+            seg.lutSize = 0;
+        seg.lut = nullptr;
+        seg.eval = getEvaluator(seg);
+    }
+    if (useTable)
+        compileTable(*snap, lutOffsets, prev.table);
+
+    builtPoints = std::move(pts);
+    publish(snap);
+}
+
+/*
+    Swaps in a new snapshot and deletes the retired ones no reader has pinned
+    A pinned snapshot stays alive until its reader acquires a newer one
+*/
+void Pattern::publish(PatternSnapshot* snap)
+{
+    RTAudit::Lock lock(mtx);
+    retired.push_back(snapshot.exchange(snap));
+
+    auto* audioPinned = audioSnapshot.load();
+    auto* uiPinned = uiSnapshot.load();
+    retired.erase(std::remove_if(retired.begin(), retired.end(), [audioPinned, uiPinned](PatternSnapshot* s) {
+        if (s == audioPinned || s == uiPinned)
+            return false;
+        delete s;
+        return true;
+    }), retired.end());
+}
+
+/*
+    Hazard pointer acquire, stores the snapshot as in use and
+    retries if a publisher swapped it before the store became visible
+*/
+const PatternSnapshot* Pattern::pin(std::atomic<PatternSnapshot*>& hazard)
+{
+    auto* snap = snapshot.load(std::memory_order_acquire);
+    while (true) {
+        hazard.store(snap);
+        auto* latest = snapshot.load();
+        if (latest == snap)
+            return snap;
+        snap = latest;
     }
 }
 
-// thread safe get segments
-// prevents getting segments during clear
+const PatternSnapshot* Pattern::acquireSnapshot()
+{
+    return pin(audioSnapshot);
+}
+
 std::vector<Segment> Pattern::getSegments()
 {
-    std::lock_guard<std::mutex> lock(mtx);
-    return segments;
+    return pin(uiSnapshot)->segments;
 }
 
 void Pattern::loadSine() {
@@ -234,25 +559,180 @@ void Pattern::paste()
 }
 
 /*
-  Based of https://github.com/KottV/SimpleSide/blob/main/Source/types/SSCurve.cpp
+  Precomputes everything that depends only on the segment and the tension multipliers
+  Must run again when the tension changes, setTension() is always followed by buildSegments()
 */
-double Pattern::get_y_curve(Segment seg, double x)
+void Pattern::compileSegment(Segment& seg)
 {
-    auto rise = seg.y1 > seg.y2;
-    auto tmult = dualTension ? (rise ? tensionAtk.load() : tensionRel.load()) : tensionMult.load();
-    auto ten = seg.tension + (rise ? -tmult : tmult);
-    if (ten > 1) ten = 1;
-    if (ten < -1) ten = -1;
-    ten *= -1;
-    auto pwr = pow(1.1, std::fabs(ten * 50));
+    double w = seg.x2 - seg.x1;
+    seg.invw = 1.0 / w;
+    seg.xmid = (seg.x1 + seg.x2) / 2;
+    seg.ymid = (seg.y1 + seg.y2) / 2;
+    seg.invhw = 1.0 / (seg.xmid - seg.x1);
+
+    if (seg.type == PointType::Curve || seg.type == PointType::SCurve || seg.type == PointType::HalfSine) {
+        auto rise = seg.y1 > seg.y2;
+        auto tmult = dualTension ? (rise ? tensionAtk.load() : tensionRel.load()) : tensionMult.load();
+        auto ten = seg.tension + (rise ? -tmult : tmult);
+        if (ten > 1) ten = 1;
+        if (ten < -1) ten = -1;
+        ten *= -1;
+        seg.power = std::pow(1.1, std::fabs(ten * 50));
+        seg.flip = ten < 0;
+    }
+    else if (seg.type == PointType::Pulse) {
+        seg.waves = (int)std::max(std::floor(std::pow(seg.tension,2) * 100), 1.0);
+        seg.step = w / seg.waves;
+    }
+    else if (seg.type == PointType::Wave) {
+        seg.waves = (int)(2 * std::floor(std::fabs(std::pow(seg.tension,2) * 100) + 1) - 1);
+        seg.amp = (seg.y2 - seg.y1) / 2;
+        seg.freq = seg.waves * 2 * PI / (2 * w);
+    }
+    else if (seg.type == PointType::Triangle) {
+        seg.waves = (int)(2 * std::floor(std::fabs(std::pow(seg.tension,2) * 100) + 1) - 1);
+        seg.step = w * 2 / seg.waves;
+        seg.invstep = 1.0 / seg.step;
+    }
+    else if (seg.type == PointType::Stairs) {
+        double t = std::max(std::floor(std::pow(seg.tension,2) * 150), 2.);
+        seg.waves = (int)t;
+        seg.step = seg.tension <= 0 ? w / t : w / (t-1);
+        seg.invstep = 1.0 / seg.step;
+        seg.ystep = seg.tension <= 0 ? (seg.y2 - seg.y1) / (t-1) : (seg.y2 - seg.y1) / t;
+    }
+    else if (seg.type == PointType::SmoothSt) {
+        double t = std::max(std::floor(std::pow(seg.tension,2) * 150), 1.0);
+        seg.waves = (int)t;
+        seg.step = w / t;
+        seg.invstep = 1.0 / seg.step;
+        seg.ystep = (seg.y2 - seg.y1) / t;
+    }
 
+    seg.eval = getEvaluator(seg);
+}
+
+/*
+  Number of table intervals that keeps linear interpolation within LUT_TOLERANCE
+  Linear interpolation error is bounded by h^2 / 8 * max|f''|, f'' is estimated
+  from the segment content in normalized x. Curves with power below 2 have
+  unbounded f'' at the start, their error there is bounded by h^p / 4 instead.
+  Zero means the segment evaluates exactly, either because it is cheap
+  or because the table could not meet the tolerance
+*/
+int Pattern::getTableResolution(const Segment& seg)
+{
     if (seg.x1 == seg.x2)
-        return seg.y2;
+        return 0;
+
+    double dy = std::fabs(seg.y2 - seg.y1);
+    double p = seg.power;
+    double d2 = 0.0; // max second derivative
+    double n = 0.0;
+    if (seg.type == PointType::Curve) {
+        d2 = dy * p * (p - 1);
+        if (p < 2.0) n = std::pow(dy / 4 / LUT_TOLERANCE, 1 / p);
+    }
+    else if (seg.type == PointType::SCurve) {
+        d2 = dy * 2 * p * (p - 1);
+        if (p < 2.0) n = 2 * std::pow(dy / 8 / LUT_TOLERANCE, 1 / p);
+    }
+    else if (seg.type == PointType::HalfSine)
+        d2 = dy * (p * p + PI * PI);
+    else if (seg.type == PointType::Wave)
+        d2 = dy / 2 * std::pow(seg.waves * PI, 2);
+    else if (seg.type == PointType::SmoothSt)
+        d2 = dy * 24 * seg.waves;
+    else
+        return 0; // hold, pulse, stairs and triangle are exact and cheap
+
+    if (d2 == 0.0)
+        return 0; // flat or linear
+    n = std::ceil(std::max(n, std::sqrt(d2 / (8 * LUT_TOLERANCE))));
+    return n > LUT_MAX_SIZE ? 0 : std::max((int)n, 2);
+}
 
-    if (ten >= 0)
-        return std::pow((x - seg.x1) / (seg.x2 - seg.x1), pwr) * (seg.y2 - seg.y1) + seg.y1;
+/*
+  Samples each smooth segment into a table sized from its content
+  Discontinuous types keep exact evaluation so edges stay sample accurate
+  Segments with nodes in lutNodes of the same resolution copy them instead
+*/
+void Pattern::compileTable(PatternSnapshot& snap, const std::vector<int>& lutOffsets, const std::vector<double>& lutNodes)
+{
+    std::vector<int> sizes(snap.segments.size(), 0);
+    int total = 0;
+    for (size_t i = 0; i < snap.segments.size(); ++i) {
+        auto seg = snap.segments[i];
+        if (seg.x2 < 0.0 || seg.x1 > 1.0)
+            continue; // ghost segments outside the visible range are never read
+        int n = getTableResolution(seg);
+        if (n > 0 && total + n + 1 <= LUT_BUDGET) {
+            sizes[i] = n;
+            total += n + 1;
+        }
+    }
+
+    snap.table.resize(total);
+    int offset = 0;
+    for (size_t i = 0; i < snap.segments.size(); ++i) {
+        auto& seg = snap.segments[i];
+        int n = sizes[i];
+        if (n == 0) {
+            seg.lutSize = 0;
+            continue;
+        }
+        if (lutOffsets[i] >= 0 && seg.lutSize == n) {
+            std::copy_n(lutNodes.begin() + lutOffsets[i], n + 1, snap.table.begin() + offset);
+        }
+        else {
+            for (int k = 0; k < n; ++k)
+                snap.table[offset + k] = get_y_segment(seg, seg.x1 + (seg.x2 - seg.x1) * k / n);
+            snap.table[offset + n] = get_y_segment(seg, seg.x2);
+        }
+        seg.lut = snap.table.data() + offset;
+        seg.lutSize = n;
+        seg.eval = &get_y_table;
+        offset += n + 1;
+    }
+}
+
+double Pattern::get_y_table(const Segment& seg, double x)
+{
+    double pos = (x - seg.x1) * seg.invw * seg.lutSize;
+    int i = std::min(std::max((int)pos, 0), seg.lutSize - 1);
+    double f = pos - i;
+    return seg.lut[i] + (seg.lut[i + 1] - seg.lut[i]) * f;
+}
+
+double Pattern::get_y_hold(const Segment& seg, double x)
+{
+    (void)x;
+    return seg.y1;
+}
+
+// zero width segments jump straight to the end value
+double Pattern::get_y_point(const Segment& seg, double x)
+{
+    (void)x;
+    return seg.y2;
+}
+
+double Pattern::get_y_none(const Segment& seg, double x)
+{
+    (void)seg; (void)x;
+    return -1;
+}
+
+/*
+  Based of https://github.com/KottV/SimpleSide/blob/main/Source/types/SSCurve.cpp
+*/
+template <bool Flip>
+double Pattern::get_y_curve(const Segment& seg, double x)
+{
+    if constexpr (!Flip)
+        return std::pow((x - seg.x1) * seg.invw, seg.power) * (seg.y2 - seg.y1) + seg.y1;
 
-    return -1 * (std::pow(1 - (x - seg.x1) / (seg.x2 - seg.x1), pwr) - 1) * (seg.y2 - seg.y1) + seg.y1;
+    return -1 * (std::pow(1 - (x - seg.x1) * seg.invw, seg.power) - 1) * (seg.y2 - seg.y1) + seg.y1;
 }
 
 int Pattern::getWaveCount(Segment seg)
@@ -265,152 +745,142 @@ int Pattern::getWaveCount(Segment seg)
     return 0;
 }
 
-double Pattern::get_y_scurve(Segment seg, double x)
+template <bool Flip>
+double Pattern::get_y_scurve(const Segment& seg, double x)
 {
-  auto rise = seg.y1 > seg.y2;
-  auto tmult = dualTension ? (rise ? tensionAtk.load() : tensionRel.load()) : tensionMult.load();
-  auto ten = seg.tension + (rise ? -tmult : tmult);
-  if (ten > 1) ten = 1;
-  if (ten < -1) ten = -1;
-  ten *= -1;
-  auto pwr = pow(1.1, std::fabs(ten * 50));
-
-  double xx = (seg.x2 + seg.x1) / 2;
-  double yy = (seg.y2 + seg.y1) / 2;
-
-  if (seg.x1 == seg.x2)
-    return seg.y2;
-
-  if (x < xx && ten >=0)
-    return std::pow((x - seg.x1) / (xx - seg.x1), pwr) * (yy - seg.y1) + seg.y1;
-
-  if (x < xx && ten < 0)
-    return -1 * (std::pow(1 - (x - seg.x1) / (xx - seg.x1), pwr) - 1) * (yy - seg.y1) + seg.y1;
-
-  if (x >= xx && ten >= 0)
-    return -1 * (std::pow(1 - (x - xx) / (seg.x2 - xx), pwr) - 1) * (seg.y2 - yy) + yy;
+  if constexpr (!Flip) {
+    if (x < seg.xmid)
+      return std::pow((x - seg.x1) * seg.invhw, seg.power) * (seg.ymid - seg.y1) + seg.y1;
+    return -1 * (std::pow(1 - (x - seg.xmid) * seg.invhw, seg.power) - 1) * (seg.y2 - seg.ymid) + seg.ymid;
+  }
 
-   return std::pow((x - xx) / (seg.x2 - xx), pwr) * (seg.y2 - yy) + yy;
+  if (x < seg.xmid)
+    return -1 * (std::pow(1 - (x - seg.x1) * seg.invhw, seg.power) - 1) * (seg.ymid - seg.y1) + seg.y1;
+  return std::pow((x - seg.xmid) * seg.invhw, seg.power) * (seg.y2 - seg.ymid) + seg.ymid;
 }
 
-double Pattern::get_y_pulse(Segment seg, double x)
+// Rise starts high, tension > 0
+template <bool Rise>
+double Pattern::get_y_pulse(const Segment& seg, double x)
 {
-  double t = std::max(std::floor(std::pow(seg.tension,2) * 100), 1.0); // num waves
-
   if (x == seg.x2)
     return seg.y2;
 
-  double cycle_width = (seg.x2 - seg.x1) / t;
-  double x_in_cycle = cycle_width == 0.0 ? 0.0 : std::fmod((x - seg.x1), cycle_width);
-  return x_in_cycle < cycle_width / 2
-    ? (seg.tension <= 0 ? seg.y1 : seg.y2)
-    : (seg.tension <= 0 ? seg.y2 : seg.y1);
+  double x_in_cycle = seg.step == 0.0 ? 0.0 : std::fmod((x - seg.x1), seg.step);
+  if constexpr (Rise)
+    return x_in_cycle < seg.step / 2 ? seg.y2 : seg.y1;
+  return x_in_cycle < seg.step / 2 ? seg.y1 : seg.y2;
 }
 
-double Pattern::get_y_wave(Segment seg, double x)
+double Pattern::get_y_wave(const Segment& seg, double x)
 {
-  double t = 2 * std::floor(std::fabs(std::pow(seg.tension,2) * 100) + 1) - 1; // wave num
-  double amp = (seg.y2 - seg.y1) / 2;
-  double vshift = seg.y1 + amp;
-  double freq = t * 2 * PI / (2 * (seg.x2 - seg.x1));
-  return -amp * cos(freq * (x - seg.x1)) + vshift;
+  return -seg.amp * std::cos(seg.freq * (x - seg.x1)) + seg.y1 + seg.amp;
 }
 
-double Pattern::get_y_triangle(Segment seg, double x)
+double Pattern::get_y_triangle(const Segment& seg, double x)
 {
-  double tt = 2 * std::floor(std::fabs(std::pow(seg.tension,2) * 100) + 1) - 1.0;// wave num
-  double amp = seg.y2 - seg.y1;
-  double t = (seg.x2 - seg.x1) * 2 / tt;
-  return amp * (2 * std::fabs((x - seg.x1) / t - std::floor(1./2. + (x - seg.x1) / t))) + seg.y1;
+  double t = (x - seg.x1) * seg.invstep;
+  return (seg.y2 - seg.y1) * (2 * std::fabs(t - std::floor(1./2. + t))) + seg.y1;
 }
 
-double Pattern::get_y_stairs(Segment seg, double x)
+// Rise steps at the start of each step, tension > 0
+template <bool Rise>
+double Pattern::get_y_stairs(const Segment& seg, double x)
 {
-  double t = std::max(std::floor(std::pow(seg.tension,2) * 150), 2.); // num waves
-  double step_size = 0.;
-  double step_index = 0.;
-  double y_step_size = 0.;
-
-  if (seg.tension <= 0) {
-    step_size = (seg.x2 - seg.x1) / t;
-    step_index = std::floor((x - seg.x1) / step_size);
-    y_step_size = (seg.y2 - seg.y1) / (t-1);
-  }
-  else {
-    step_size = (seg.x2 - seg.x1) / (t-1);
-    step_index = ceil((x - seg.x1) / step_size);
-    y_step_size = (seg.y2 - seg.y1) / t;
-  }
-
   if (x == seg.x2)
     return seg.y2;
 
-  return seg.y1 + step_index * y_step_size;
+  double step_index = Rise
+    ? std::ceil((x - seg.x1) * seg.invstep)
+    : std::floor((x - seg.x1) * seg.invstep);
+
+  return seg.y1 + step_index * seg.ystep;
 }
 
-double Pattern::get_y_smooth_stairs(Segment seg, double x)
+// Rise eases out then in on each step, tension > 0
+template <bool Rise>
+double Pattern::get_y_smooth_stairs(const Segment& seg, double x)
 {
-  double pwr = 4;
-  double t = std::max(floor(std::pow(seg.tension,2) * 150), 1.0); // num waves
-
-  double gx = (seg.x2 - seg.x1) / t; // gridx
-  double gy = (seg.y2 - seg.y1) / t; // gridy
-  double step_index = std::floor((x - seg.x1) / gx);
-
-  double xx1 = seg.x1 + gx * step_index;
-  double xx2 = seg.x1 + gx * (step_index + 1);
-  double xx = (xx1 + xx2) / 2;
-
-  double yy1 = seg.y1 + gy * step_index;
-  double yy2 = seg.y1 + gy * (step_index + 1);
-  double yy = (yy1 + yy2) / 2;
-
-  if (seg.x1 == seg.x2)
-    return seg.y2;
-
-  if (x < xx && seg.tension <= 0)
-    return std::pow((x - xx1) / (xx - xx1), pwr) * (yy - yy1) + yy1;
-
-  if (x < xx && seg.tension > 0)
-    return -1 * (std::pow(1 - (x - xx1) / (xx - xx1), pwr) - 1) * (yy - yy1) + yy1;
-
-  if (x >= xx && seg.tension <= 0)
-    return -1 * (std::pow(1 - (x - xx) / (xx2 - xx), pwr) - 1) * (yy2 - yy) + yy;
+  double step_index = std::floor((x - seg.x1) * seg.invstep);
+
+  double xx1 = seg.x1 + seg.step * step_index;
+  double xx = xx1 + seg.step / 2;
+  double yy1 = seg.y1 + seg.ystep * step_index;
+  double yy = yy1 + seg.ystep / 2;
+  double hinv = 2 * seg.invstep; // 1 / half step
+
+  double t = 0.0;
+  if (x < xx) {
+    if constexpr (!Rise) {
+      t = (x - xx1) * hinv;
+      return t * t * t * t * (yy - yy1) + yy1;
+    }
+    t = 1 - (x - xx1) * hinv;
+    return -1 * (t * t * t * t - 1) * (yy - yy1) + yy1;
+  }
 
-  return std::pow((x - xx) / (xx2 - xx), pwr) * (yy2 - yy) + yy;
+  double yy2 = yy1 + seg.ystep;
+  if constexpr (!Rise) {
+    t = 1 - (x - xx) * hinv;
+    return -1 * (t * t * t * t - 1) * (yy2 - yy) + yy;
+  }
+  t = (x - xx) * hinv;
+  return t * t * t * t * (yy2 - yy) + yy;
 }
 
-double Pattern::get_y_half_sine(Segment seg, double x)
+template <bool Flip>
+double Pattern::get_y_half_sine(const Segment& seg, double x)
 {
-    auto rise = seg.y1 > seg.y2;
-    auto tmult = dualTension ? (rise ? tensionAtk.load() : tensionRel.load()) : tensionMult.load();
-    auto ten = seg.tension + (rise ? -tmult : tmult);
-    ten *= -1;
-    if (ten > 1) ten = 1;
-    if (ten < -1) ten = -1;
-    auto pwr = pow(1.1, std::fabs(ten * 50.));
-
-    if (seg.x1 == seg.x2)
-        return seg.y2;
-
-    double t = (x - seg.x1) / (seg.x2 - seg.x1);
+    double t = (x - seg.x1) * seg.invw;
     t = 0.5 - 0.5 * std::cos(PI * t);
 
-    t = ten >= 0
-        ? std::pow(t, pwr)
-        : t = 1.0 - std::pow(1.0 - t, pwr);
+    if constexpr (!Flip)
+        t = std::pow(t, seg.power);
+    else
+        t = 1.0 - std::pow(1.0 - t, seg.power);
 
     return t * (seg.y2 - seg.y1) + seg.y1;
 }
 
+/*
+  Picks the evaluator specialized for the segment type and tension direction
+  so per sample evaluation is a single indirect call
+*/
+SegmentEval Pattern::getEvaluator(const Segment& seg)
+{
+    bool zeroWidth = seg.x1 == seg.x2;
+    bool rise = seg.tension > 0;
+    switch (seg.type) {
+        case PointType::Hold: return &get_y_hold;
+        case PointType::Curve: return zeroWidth ? &get_y_point : seg.flip ? &get_y_curve<true> : &get_y_curve<false>;
+        case PointType::SCurve: return zeroWidth ? &get_y_point : seg.flip ? &get_y_scurve<true> : &get_y_scurve<false>;
+        case PointType::Pulse: return rise ? &get_y_pulse<true> : &get_y_pulse<false>;
+        case PointType::Wave: return &get_y_wave;
+        case PointType::Triangle: return &get_y_triangle;
+        case PointType::Stairs: return rise ? &get_y_stairs<true> : &get_y_stairs<false>;
+        case PointType::SmoothSt: return zeroWidth ? &get_y_point : rise ? &get_y_smooth_stairs<true> : &get_y_smooth_stairs<false>;
+        case PointType::HalfSine: return zeroWidth ? &get_y_point : seg.flip ? &get_y_half_sine<true> : &get_y_half_sine<false>;
+        default: return &get_y_none;
+    }
+}
 
 double Pattern::get_y_at(double x)
 {
-    std::lock_guard<std::mutex> lock(mtx); // prevents crash while building segments
+    return get_y_at(*pin(uiSnapshot), x);
+}
+
+double Pattern::get_y_segment(const Segment& seg, double x)
+{
+    return seg.eval(seg, x);
+}
+
+// binary search the segment containing x, returns -1 if none
+int Pattern::findSegment(const PatternSnapshot& snap, double x)
+{
+    const auto& segments = snap.segments;
     int low = 0;
     int high = static_cast<int>(segments.size()) - 1;
 
-    // binary search the segment containing x
     while (low <= high) {
         int mid = (low + high) / 2;
         const auto& seg = segments[mid];
@@ -420,38 +890,155 @@ double Pattern::get_y_at(double x)
         } else if (x > seg.x2) {
             low = mid + 1;
         } else {
-            if (seg.type == PointType::Hold) return seg.y1; // hold
-            if (seg.type == PointType::Curve) return get_y_curve(seg, x);
-            if (seg.type == PointType::SCurve) return get_y_scurve(seg, x);
-            if (seg.type == PointType::Pulse) return get_y_pulse(seg, x);
-            if (seg.type == PointType::Wave) return get_y_wave(seg, x);
-            if (seg.type == PointType::Triangle) return get_y_triangle(seg, x);
-            if (seg.type == PointType::Stairs) return get_y_stairs(seg, x);
-            if (seg.type == PointType::SmoothSt) return get_y_smooth_stairs(seg, x);
-            if (seg.type == PointType::HalfSine) return get_y_half_sine(seg, x);
-            return -1;
+            return mid;
         }
     }
 
     return -1;
 }
 
-void Pattern::createUndo()
+double Pattern::get_y_at(const PatternSnapshot& snap, double x)
+{
+    int idx = findSegment(snap, x);
+    return idx == -1 ? -1 : get_y_segment(snap.segments[idx], x);
+}
+
+/*
+    Evaluates x starting from the segment found on the last call
+    x usually moves forward by a small increment so the cursor
+    only steps to the next segment, wrap arounds fall back to binary search
+*/
+double Pattern::get_y_at(const PatternSnapshot& snap, int& cursor, double x)
+{
+    cursor = seekSegment(snap, cursor, x);
+    return cursor == -1 ? -1 : get_y_segment(snap.segments[cursor], x);
+}
+
+// steps the cursor forward to the segment containing x, returns -1 if none
+int Pattern::seekSegment(const PatternSnapshot& snap, int cursor, double x)
+{
+    const auto& segments = snap.segments;
+    const int size = static_cast<int>(segments.size());
+
+    if (cursor >= 0 && cursor < size && x >= segments[cursor].x1) {
+        while (cursor < size - 1 && x > segments[cursor].x2)
+            cursor += 1;
+        if (x <= segments[cursor].x2)
+            return cursor;
+    }
+
+    return findSegment(snap, x);
+}
+
+/*
+    Evaluates n positions of the same segment in place, xy holds x on input and y on output
+    Curves and waves are mapped to their pow or cos argument, run through
+    the batched approximations and mapped back, other types evaluate per sample
+*/
+void Pattern::renderSegment(const Segment& seg, double* xy, int n)
 {
-    if (undoStack.size() > globals::MAX_UNDO) {
-        undoStack.erase(undoStack.begin());
+    if (seg.lut || seg.x1 == seg.x2) {
+        for (int i = 0; i < n; ++i)
+            xy[i] = get_y_segment(seg, xy[i]);
+        return;
     }
-    undoStack.push_back(points);
+
+    const double x1 = seg.x1;
+    const double y1 = seg.y1;
+    const double dy = seg.y2 - seg.y1;
+
+    if (seg.type == PointType::Curve) {
+        for (int i = 0; i < n; ++i) {
+            double u = (xy[i] - x1) * seg.invw;
+            xy[i] = std::min(std::max(seg.flip ? 1.0 - u : u, 0.0), 1.0);
+        }
+        powBlock(xy, seg.power, n);
+        for (int i = 0; i < n; ++i)
+            xy[i] = (seg.flip ? 1.0 - xy[i] : xy[i]) * dy + y1;
+    }
+    else if (seg.type == PointType::SCurve) {
+        // first half eases in and second half eases out, reversed when flipped
+        auto easeIn = [&seg](double x) { return (x < seg.xmid) != seg.flip; };
+        double x[64];
+        for (int base = 0; base < n; base += 64) {
+            double* out = xy + base;
+            int count = std::min(64, n - base);
+            for (int i = 0; i < count; ++i) {
+                x[i] = out[i];
+                double u = x[i] < seg.xmid ? (x[i] - x1) * seg.invhw : (x[i] - seg.xmid) * seg.invhw;
+                out[i] = std::min(std::max(easeIn(x[i]) ? u : 1.0 - u, 0.0), 1.0);
+            }
+            powBlock(out, seg.power, count);
+            for (int i = 0; i < count; ++i) {
+                double t = easeIn(x[i]) ? out[i] : 1.0 - out[i];
+                out[i] = x[i] < seg.xmid
+                    ? t * (seg.ymid - y1) + y1
+                    : t * (seg.y2 - seg.ymid) + seg.ymid;
+            }
+        }
+    }
+    else if (seg.type == PointType::HalfSine) {
+        for (int i = 0; i < n; ++i)
+            xy[i] = PI * (xy[i] - x1) * seg.invw;
+        cosBlock(xy, n);
+        for (int i = 0; i < n; ++i) {
+            double t = std::min(std::max(0.5 - 0.5 * xy[i], 0.0), 1.0);
+            xy[i] = seg.flip ? 1.0 - t : t;
+        }
+        powBlock(xy, seg.power, n);
+        for (int i = 0; i < n; ++i)
+            xy[i] = (seg.flip ? 1.0 - xy[i] : xy[i]) * dy + y1;
+    }
+    else if (seg.type == PointType::Wave) {
+        for (int i = 0; i < n; ++i)
+            xy[i] = seg.freq * (xy[i] - x1);
+        cosBlock(xy, n);
+        for (int i = 0; i < n; ++i)
+            xy[i] = -seg.amp * xy[i] + y1 + seg.amp;
+    }
+    else {
+        for (int i = 0; i < n; ++i)
+            xy[i] = get_y_segment(seg, xy[i]);
+    }
+}
+
+/*
+    Evaluates numSamples positions in [0, 1) in place, xy holds x on input and y on output
+    Positions may hold, jump or restart, consecutive samples in the same segment are batched
+*/
+void Pattern::renderPositions(const PatternSnapshot& snap, double* xy, int numSamples)
+{
+    const auto& segments = snap.segments;
+    int cursor = -1;
+    int i = 0;
+    while (i < numSamples) {
+        cursor = seekSegment(snap, cursor, xy[i]);
+        if (cursor == -1) {
+            xy[i++] = -1;
+            continue;
+        }
+        const auto& seg = segments[cursor];
+        int end = i + 1;
+        while (end < numSamples && xy[end] >= seg.x1 && xy[end] <= seg.x2)
+            end += 1;
+        renderSegment(seg, xy + i, end - i);
+        i = end;
+    }
+}
+
+void Pattern::createUndo()
+{
+    undoStack.push(points);
     redoStack.clear();
 }
+
 void Pattern::undo()
 {
     if (undoStack.empty())
         return;
 
-    redoStack.push_back(points);
-    points = undoStack.back();
-    undoStack.pop_back();
+    redoStack.push(points);
+    points = undoStack.pop();
 
     incrementVersion();
     buildSegments();
@@ -462,9 +1049,8 @@ void Pattern::redo()
     if (redoStack.empty())
         return;
 
-    undoStack.push_back(points);
-    points = redoStack.back();
-    redoStack.pop_back();
+    undoStack.push(points);
+    points = redoStack.pop();
 
     incrementVersion();
     buildSegments();
@@ -478,17 +1064,5 @@ void Pattern::clearUndo()
 
 bool Pattern::comparePoints(const std::vector<PPoint>& a, const std::vector<PPoint>& b)
 {
-    if (a.size() != b.size()) {
-        return false;
-    }
-    for (size_t i = 0; i < a.size(); ++i) {
-        if (a[i].id != b[i].id ||
-            a[i].x != b[i].x ||
-            a[i].y != b[i].y ||
-            a[i].tension != b[i].tension ||
-            a[i].type != b[i].type) {
-            return false;
-        }
-    }
-    return true;
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), PPointEqual());
 }
\ No newline at end of file
@@ -9,8 +9,11 @@
 
 #pragma once
 #include <vector>
+#include <string>
 #include <mutex>
 #include <atomic>
+#include <unordered_map>
+#include "../utils/UndoJournal.h"
 
 enum PointType {
     Hold,
@@ -32,14 +35,53 @@ struct PPoint {
     int type;
 };
 
+struct PPointEqual {
+    bool operator()(const PPoint& a, const PPoint& b) const {
+        return a.id == b.id && a.x == b.x && a.y == b.y && a.tension == b.tension && a.type == b.type;
+    }
+};
+
+struct Segment;
+typedef double (*SegmentEval)(const Segment& seg, double x);
+
 struct Segment {
     double x1;
     double x2;
     double y1;
     double y2;
     double tension;
-    double power;
+    double power; // curve exponent including the global tension multipliers
     int type;
+
+    // precompiled by buildSegments(), leaves only the x dependent math per sample
+    bool flip = false; // effective tension is negative, curve is mirrored
+    int waves = 0; // number of waves, pulses or steps
+    double invw = 0.0; // 1 / segment width
+    double xmid = 0.0; // segment center
+    double ymid = 0.0;
+    double invhw = 0.0; // 1 / half segment width
+    double amp = 0.0; // wave amplitude
+    double freq = 0.0; // wave angular frequency
+    double step = 0.0; // width of one cycle or step
+    double invstep = 0.0; // 1 / step
+    double ystep = 0.0; // height of one step
+    const double* lut = nullptr; // lookup table nodes inside PatternSnapshot::table, nullptr evaluates exactly
+    int lutSize = 0; // number of table intervals
+    SegmentEval eval = nullptr; // evaluator specialized for the type and tension direction
+};
+
+/*
+    Immutable compiled segment table
+    Built by buildSegments() and published atomically, readers never lock
+    Rebuilds start from the previous snapshot and only recompile edited segments
+*/
+struct PatternSnapshot {
+    std::vector<Segment> segments;
+    std::vector<double> table; // interpolation nodes of all segments using lookup
+    double tensionMult = 0.0; // tension multipliers the segments were compiled with
+    double tensionAtk = 0.0;
+    double tensionRel = 0.0;
+    bool dualTension = false;
 };
 
 class Pattern
@@ -48,16 +90,20 @@ public:
     uint64_t versionID = 0; // unique pattern ID, used by UI to detect pattern changes and update selection
     static std::vector<PPoint> copy_pattern;
     static constexpr double PI = 3.14159265358979323846;
+    static constexpr double LUT_TOLERANCE = 1e-5; // max interpolation error of lookup tables
+    static constexpr int LUT_MAX_SIZE = 1 << 14; // max intervals per segment
+    static constexpr int LUT_BUDGET = 1 << 18; // max table nodes per pattern, remaining segments evaluate exactly
     int index;
     std::vector<PPoint> points;
-    std::vector<Segment> segments;
-    std::vector<std::vector<PPoint>> undoStack;
-    std::vector<std::vector<PPoint>> redoStack;
+    UndoJournal<PPoint, PPointEqual> undoStack;
+    UndoJournal<PPoint, PPointEqual> redoStack;
     std::atomic<double> tensionMult = 0.0; // tension multiplier applied to all points
     std::atomic<double> tensionAtk = 0.0; // tension multiplier for attack only
     std::atomic<double> tensionRel = 0.0; // tension multiplier for release only
+    bool useTable = false; // compile lookup tables along with the segments
 
-    Pattern(int index);
+    Pattern(int index, UndoBudget& undoBudget); // undo history counts against the instance budget
+    ~Pattern();
     void incrementVersion(); // generates a new unique ID for this pattern
 
     int insertPoint(double x, double y, double tension, int type, bool sort = true);
@@ -67,6 +113,10 @@ public:
     void removePoint(double x, double y);
     void removePoint(int i);
     void removePointsInRange(double x1, double x2);
+    void replacePointsInRange(double x1, double x2, std::vector<PPoint> pts);
+    void assignPoints(const std::vector<PPoint>& pts);
+    static std::vector<PPoint> parsePoints(const std::string& str); // "x y tension type" quadruplets
+    int getPointIndex(uint64_t id); // -1 if not found
     void invert();
     void reverse();
     void rotate(double x);
@@ -74,6 +124,7 @@ public:
     void clear();
     void buildSegments();
     std::vector<Segment> getSegments();
+    const PatternSnapshot* acquireSnapshot(); // audio thread only, pins the published snapshot until the next acquire
     void loadSine();
     void loadTriangle();
     void loadRandom(int grid);
@@ -81,15 +132,22 @@ public:
     void paste();
     int getWaveCount(Segment seg);
 
-    double get_y_curve(Segment seg, double x);
-    double get_y_scurve(Segment seg, double x);
-    double get_y_pulse(Segment seg, double x);
-    double get_y_wave(Segment seg, double x);
-    double get_y_triangle(Segment seg, double x);
-    double get_y_stairs(Segment seg, double x);
-    double get_y_smooth_stairs(Segment seg, double x);
-    double get_y_half_sine(Segment seg, double x);
+    static double get_y_hold(const Segment& seg, double x);
+    static double get_y_point(const Segment& seg, double x);
+    static double get_y_none(const Segment& seg, double x);
+    template <bool Flip> static double get_y_curve(const Segment& seg, double x);
+    template <bool Flip> static double get_y_scurve(const Segment& seg, double x);
+    template <bool Rise> static double get_y_pulse(const Segment& seg, double x);
+    static double get_y_wave(const Segment& seg, double x);
+    static double get_y_triangle(const Segment& seg, double x);
+    template <bool Rise> static double get_y_stairs(const Segment& seg, double x);
+    template <bool Rise> static double get_y_smooth_stairs(const Segment& seg, double x);
+    template <bool Flip> static double get_y_half_sine(const Segment& seg, double x);
+    static double get_y_table(const Segment& seg, double x);
     double get_y_at(double x);
+    double get_y_at(const PatternSnapshot& snap, double x);
+    double get_y_at(const PatternSnapshot& snap, int& cursor, double x);
+    void renderPositions(const PatternSnapshot& snap, double* xy, int numSamples);
 
     void createUndo();
     void undo();
@@ -101,6 +159,25 @@ private:
     static inline uint64_t versionIDCounter = 1; // static global ID counter
     static inline uint64_t pointsIDCounter = 1; // static global ID counter
     bool dualTension = false;
-    std::mutex mtx;
+    std::mutex mtx; // serializes snapshot publishers
+    std::mutex buildmtx; // serializes rebuilds, guards builtPoints
+    std::vector<PPoint> builtPoints; // ghost padded points the published snapshot was built from
     std::mutex pointsmtx;
+    std::unordered_map<uint64_t, int> pointIndex; // id to index cache, verified on every lookup
+
+    std::atomic<PatternSnapshot*> snapshot; // latest published segments
+    std::atomic<PatternSnapshot*> audioSnapshot = nullptr; // snapshot pinned by the audio thread
+    std::atomic<PatternSnapshot*> uiSnapshot = nullptr; // snapshot pinned by the UI thread
+    std::vector<PatternSnapshot*> retired; // replaced snapshots waiting for readers to move on
+
+    void compileSegment(Segment& seg);
+    static SegmentEval getEvaluator(const Segment& seg);
+    int getTableResolution(const Segment& seg);
+    void compileTable(PatternSnapshot& snap, const std::vector<int>& lutOffsets, const std::vector<double>& lutNodes);
+    double get_y_segment(const Segment& seg, double x);
+    void renderSegment(const Segment& seg, double* xy, int n);
+    int findSegment(const PatternSnapshot& snap, double x);
+    int seekSegment(const PatternSnapshot& snap, int cursor, double x);
+    const PatternSnapshot* pin(std::atomic<PatternSnapshot*>& hazard);
+    void publish(PatternSnapshot* snap);
 };
\ No newline at end of file
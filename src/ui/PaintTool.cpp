@@ -3,7 +3,7 @@
 
 PaintTool::PaintTool(TIME12AudioProcessor& p) : audioProcessor(p) 
 {
-    pat = new Pattern(-1);
+    pat = new Pattern(-1, p.undoBudget);
 }
 
 void PaintTool::setViewBounds(int _x, int _y, int _w, int _h)
@@ -126,8 +126,6 @@ void PaintTool::apply()
     x1 = jlimit(0.0, 1.0, x1);
     x2 = jlimit(0.0, 1.0, x2);
 
-    audioProcessor.viewPattern->removePointsInRange(x1, x2);
-
     auto points = audioProcessor.getPaintPatern(audioProcessor.paintTool)->points;
 
     // when the bounds are flat (no width or height) apply only first and last points
@@ -143,6 +141,8 @@ void PaintTool::apply()
     if (inverty) pat->invert();
     pat->buildSegments();
 
+    std::vector<PPoint> stroke;
+    stroke.reserve(pat->points.size());
     for (auto& point : pat->points) {
         double px = rx + point.x * rw; // map points to rectangle bounds
         double py = ry + point.y * rh;
@@ -150,9 +150,10 @@ void PaintTool::apply()
         py = (py - winy) / winh;
         px = jlimit(0.0, 1.0, px);
         py = jlimit(0.0, 1.0, py);
-        audioProcessor.viewPattern->insertPoint(px, py, point.tension, point.type);
+        stroke.push_back({ 0, px, py, point.tension, point.type });
     }
 
+    audioProcessor.viewPattern->replacePointsInRange(x1, x2, stroke);
     audioProcessor.viewPattern->buildSegments();
 }
 
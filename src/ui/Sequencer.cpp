@@ -1,10 +1,13 @@
 #include "Sequencer.h"
 #include "../PluginProcessor.h"
 
-Sequencer::Sequencer(TIME12AudioProcessor& p) : audioProcessor(p) 
+Sequencer::Sequencer(TIME12AudioProcessor& p)
+    : undoStack(globals::MAX_UNDO, p.undoBudget)
+    , redoStack(globals::MAX_UNDO, p.undoBudget)
+    , audioProcessor(p)
 {
-    tmp = new Pattern(-1);
-    pat = new Pattern(-1);
+    tmp = new Pattern(-1, p.undoBudget);
+    pat = new Pattern(-1, p.undoBudget);
     clear();
     ramp.push_back({ 0, 0.0, 0.0, 0.0, 1 });
     ramp.push_back({ 0, 1e-10, 1.0, 0.0, 1 }); // 1e-10 makes it sort proof
@@ -412,15 +415,20 @@ void Sequencer::open()
     audioProcessor.pattern->buildSegments();
 }
 
+/*
+    Restores the pattern the sequencer was opened on,
+    after a pattern switch that pattern is no longer the audio pattern
+*/
 void Sequencer::close()
 {
     isOpen = false;
-    if (audioProcessor.pattern->index != patternIdx)
+    if (patternIdx < 0 || patternIdx >= 12)
         return;
 
+    auto* opened = audioProcessor.getAudioPattern(patternIdx);
     patternIdx = -1;
-    audioProcessor.pattern->points = backup;
-    audioProcessor.pattern->buildSegments();
+    opened->points = backup;
+    opened->buildSegments();
 }
 
 void Sequencer::clear()
@@ -680,10 +688,7 @@ void Sequencer::createUndo(std::vector<Cell> snap)
     if (compareCells(snap, cells)) {
         return; // nothing to undo
     }
-    if (undoStack.size() > globals::MAX_UNDO) {
-        undoStack.erase(undoStack.begin());
-    }
-    undoStack.push_back(snap);
+    undoStack.push(snap);
     redoStack.clear();
     MessageManager::callAsync([this]() { audioProcessor.sendChangeMessage(); }); // repaint undo/redo buttons
 }
@@ -692,9 +697,8 @@ void Sequencer::undo()
     if (undoStack.empty())
         return;
 
-    redoStack.push_back(cells);
-    cells = undoStack.back();
-    undoStack.pop_back();
+    redoStack.push(cells);
+    cells = undoStack.pop();
 
     build();
     MessageManager::callAsync([this]() {
@@ -707,9 +711,8 @@ void Sequencer::redo()
     if (redoStack.empty()) 
         return;
 
-    undoStack.push_back(cells);
-    cells = redoStack.back();
-    redoStack.pop_back();
+    undoStack.push(cells);
+    cells = redoStack.pop();
 
     build();
     MessageManager::callAsync([this]() {
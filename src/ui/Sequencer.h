@@ -3,6 +3,7 @@
 #include <JuceHeader.h>
 #include "../Globals.h"
 #include "../dsp/Pattern.h"
+#include "../utils/UndoJournal.h"
 #include "algorithm"
 
 using namespace globals;
@@ -46,6 +47,14 @@ struct Cell {
     double skew;
 };
 
+struct CellEqual {
+    bool operator()(const Cell& a, const Cell& b) const {
+        return a.shape == b.shape && a.lshape == b.lshape && a.ptool == b.ptool && a.invertx == b.invertx
+            && a.minx == b.minx && a.maxx == b.maxx && a.miny == b.miny && a.maxy == b.maxy
+            && a.tenatt == b.tenatt && a.tenrel == b.tenrel && a.skew == b.skew;
+    }
+};
+
 class Sequencer {
 public:
     bool isOpen = false;
@@ -91,8 +100,8 @@ public:
     void randomize(SeqEditMode mode, double min, double max);
     void clear(SeqEditMode mode);
 
-    std::vector<std::vector<Cell>> undoStack;
-    std::vector<std::vector<Cell>> redoStack;
+    UndoJournal<Cell, CellEqual> undoStack;
+    UndoJournal<Cell, CellEqual> redoStack;
     void clearUndo();
     void createUndo(std::vector<Cell> snapshot);
     void undo();
@@ -66,13 +66,21 @@ void SettingsButton::mouseDown(const juce::MouseEvent& e)
 		audioOutputMIDI.addItem(500+i, midiNoteToName(i-1), true, audioProcessor.outputATMIDI == i);
 	}
 
+	PopupMenu CCRate;
+	CCRate.addItem(740, "Once per block", true, audioProcessor.outputCCRate == 0);
+	for (int i = 1; i < (int)std::size(globals::CC_RATE_MILLIS); ++i) {
+		CCRate.addItem(740 + i, String(globals::CC_RATE_MILLIS[i]) + " ms", true, audioProcessor.outputCCRate == i);
+	}
+
 	PopupMenu output;
 	output.addItem(700, "CV", true, audioProcessor.outputCV);
 	output.addSubMenu("CC", CC);
 	output.addSubMenu("CC Channel", CCChan);
+	output.addSubMenu("CC Resolution", CCRate);
 	output.addSubMenu("Audio Trig. MIDI", audioOutputMIDI);
 	output.addSeparator();
 	output.addItem(701, "Bipolar CC", true, audioProcessor.bipolarCC);
+	output.addItem(702, "14-bit CC (CC 0-31)", audioProcessor.outputCC <= 32, audioProcessor.highResCC);
 
 	PopupMenu antiNoise;
 	antiNoise.addItem(710, "Off", true, audioProcessor.anoise == ANoise::ANOff);
@@ -80,8 +88,21 @@ void SettingsButton::mouseDown(const juce::MouseEvent& e)
 	antiNoise.addItem(711, "Normal", true, audioProcessor.anoise == ANoise::ANLow);
 	antiNoise.addItem(712, "High", true, audioProcessor.anoise == ANoise::ANHigh);
 
+	PopupMenu envQuality;
+	envQuality.addItem(720, "Exact", true, audioProcessor.envQuality == EnvQuality::EnvExact);
+	envQuality.addItem(721, "Lookup table", true, audioProcessor.envQuality == EnvQuality::EnvTable);
+
+	PopupMenu delayInterp;
+	delayInterp.addItem(730, "Nearest", true, audioProcessor.delayInterp.load() == DelayInterp::InterpNearest);
+	delayInterp.addItem(731, "Linear", true, audioProcessor.delayInterp.load() == DelayInterp::InterpLinear);
+	delayInterp.addItem(732, "Cubic", true, audioProcessor.delayInterp.load() == DelayInterp::InterpCubic);
+	delayInterp.addItem(733, "Lagrange 6-point", true, audioProcessor.delayInterp.load() == DelayInterp::InterpLagrange6);
+	delayInterp.addItem(734, "Sinc (HQ)", true, audioProcessor.delayInterp.load() == DelayInterp::InterpSinc);
+
 	PopupMenu options;
 	options.addSubMenu("Anti-noise", antiNoise);
+	options.addSubMenu("Envelope quality", envQuality);
+	options.addSubMenu("Delay interpolation", delayInterp);
 	options.addSubMenu("Output", output);
 	options.addSubMenu("MIDI trigger chn", midiTriggerChn);
 	options.addSubMenu("Pattern select chn", triggerChn);
@@ -344,12 +365,24 @@ void SettingsButton::mouseDown(const juce::MouseEvent& e)
 			else if (result == 701) {
 				audioProcessor.bipolarCC = !audioProcessor.bipolarCC;
 			}
+			else if (result == 702) {
+				audioProcessor.highResCC = !audioProcessor.highResCC;
+			}
+			else if (result >= 740 && result < 740 + (int)std::size(globals::CC_RATE_MILLIS)) {
+				audioProcessor.outputCCRate = result - 740;
+			}
 			else if (result >= 710 && result <= 713) {
 				auto anoise = (ANoise)(result - 710);
 				MessageManager::callAsync([this, anoise]() {
 					audioProcessor.setAntiNoise(anoise);
 				});
 			}
+			else if (result == 720 || result == 721) {
+				audioProcessor.setEnvQuality((EnvQuality)(result - 720));
+			}
+			else if (result >= 730 && result <= 734) {
+				audioProcessor.delayInterp = result - 730;
+			}
 			else if (result == 1000) {
 				toggleAbout();
 			}
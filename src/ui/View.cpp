@@ -371,23 +371,13 @@ uint64_t View::getHoveredMidpoint(int x, int y)
 
 PPoint& View::getPoint(uint64_t id)
 {
-    for (auto& point : audioProcessor.viewPattern->points) {
-        if (point.id == id) {
-            return point;
-        }
-    }
-    return dummyPoint;
+    int idx = audioProcessor.viewPattern->getPointIndex(id);
+    return idx == -1 ? dummyPoint : audioProcessor.viewPattern->points[idx];
 }
 
 int View::getPointIndex(uint64_t id)
 {
-    auto sz = audioProcessor.viewPattern->points.size();
-    for (int i = 0; i < sz; ++i) {
-        if (audioProcessor.viewPattern->points[i].id == id) {
-            return i;
-        }
-    }
-    return 0;
+    return std::max(audioProcessor.viewPattern->getPointIndex(id), 0);
 }
 
 // Midpoint index is derived from segment nu
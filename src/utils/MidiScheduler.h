@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+struct MidiOutMsg {
+    int64_t time; // absolute sample the message is due on
+    uint8_t data[3]; // raw short message, status then data bytes
+};
+
+/**
+ * Fixed capacity queue of outgoing short MIDI messages stamped with absolute sample times.
+ * Written and drained by the audio thread only, so it needs no locks and never allocates.
+ * Messages must be pushed in non decreasing time order, which holds for note offs
+ * scheduled a constant length after their note on.
+ */
+template <int Capacity>
+class MidiScheduler
+{
+public:
+    bool empty() const { return count == 0; }
+    int size() const { return count; }
+
+    void clear()
+    {
+        head = 0;
+        count = 0;
+    }
+
+    // returns false and drops the message when the queue is full
+    bool push(int64_t time, uint8_t status, uint8_t data1, uint8_t data2)
+    {
+        if (count == Capacity)
+            return false;
+
+        queue[(head + count) % Capacity] = { time, { status, data1, data2 } };
+        count += 1;
+        return true;
+    }
+
+    // emits every message due before blockStart + numSamples with its offset in the block,
+    // messages that were due in earlier blocks are emitted at offset 0
+    template <typename Emit>
+    void drain(int64_t blockStart, int numSamples, Emit&& emit)
+    {
+        while (count > 0 && queue[head].time < blockStart + numSamples) {
+            auto& msg = queue[head];
+            emit(msg.data, (int)std::max<int64_t>(0, msg.time - blockStart));
+            head = (head + 1) % Capacity;
+            count -= 1;
+        }
+    }
+
+private:
+    std::array<MidiOutMsg, Capacity> queue{};
+    int head = 0; // oldest message
+    int count = 0;
+};
@@ -27,23 +27,14 @@ void PatternManager::importPatterns(Pattern* patterns[PATTERN_COUNT],const Tensi
 
 				for (int i = 0; i < PATTERN_COUNT; ++i)
 				{
-					patterns[i]->clear();
-					patterns[i]->clearUndo();
-
-					double x, y, tension;
-					int type;
 					std::string line;
 
 					if (!std::getline(iss, line))
 						break;
 
-					std::istringstream lineStream(line);
-					while (lineStream >> x >> y >> tension >> type)
-					{
-						patterns[i]->insertPoint(x, y, tension, type, false);
-					}
+					patterns[i]->clearUndo();
 					patterns[i]->setTension(tensionParameters.tension, tensionParameters.tensionAtk, tensionParameters.tensionRel, tensionParameters.dualTension);
-					patterns[i]->buildSegments();
+					patterns[i]->assignPoints(Pattern::parsePoints(line));
 				}
 			}
 
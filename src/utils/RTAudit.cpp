@@ -0,0 +1,184 @@
+#include "RTAudit.h"
+
+#if TIME12_RT_AUDIT
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if TIME12_RT_AUDIT_PTHREAD
+ #include <dlfcn.h>
+ #include <pthread.h>
+#endif
+
+namespace
+{
+    constexpr int MAX_TAGS = 8; // deeper scopes are counted but not named
+    constexpr int MAX_REPORTS = 64; // stderr lines, violations keep being counted after that
+
+    thread_local const char* tags[MAX_TAGS];
+    thread_local int depth = 0;
+    thread_local bool reporting = false; // allocations made while reporting are not violations
+    std::atomic<int> count { 0 };
+    std::atomic<bool> abortOnViolation { false };
+    std::atomic<bool> hookLocks { false };
+}
+
+void RTAudit::enter(const char* tag)
+{
+    if (depth < MAX_TAGS)
+        tags[depth] = tag;
+    depth += 1;
+}
+
+void RTAudit::leave()
+{
+    depth -= 1;
+}
+
+void RTAudit::violation(const char* what)
+{
+    if (depth == 0 || reporting)
+        return;
+
+    reporting = true;
+    if (count.fetch_add(1) < MAX_REPORTS) {
+        std::fprintf(stderr, "RT audit: %s in ", what);
+        for (int i = 0; i < std::min(depth, MAX_TAGS); ++i)
+            std::fprintf(stderr, i == 0 ? "%s" : " > %s", tags[i]);
+        std::fputc('\n', stderr);
+    }
+    if (abortOnViolation.load())
+        std::abort();
+    reporting = false;
+}
+
+void RTAudit::setAbort(bool abort)
+{
+    abortOnViolation.store(abort);
+}
+
+void RTAudit::setHookLocks(bool hook)
+{
+    hookLocks.store(hook && TIME12_RT_AUDIT_PTHREAD);
+}
+
+bool RTAudit::locksHooked()
+{
+    return hookLocks.load(std::memory_order_relaxed);
+}
+
+int RTAudit::violations()
+{
+    return count.load();
+}
+
+// global allocation hooks, active for the whole binary while the audit is compiled in
+
+void* operator new(std::size_t size)
+{
+    RTAudit::violation("operator new");
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    RTAudit::violation("operator new");
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p)
+        RTAudit::violation("operator delete");
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+#if TIME12_RT_AUDIT_PTHREAD
+
+// pthread lock hooks, they shadow the libc symbols and forward to them,
+// std::mutex, std::shared_mutex and juce::CriticalSection all lock through these.
+// They only report after setHookLocks(true), which the RT safety test calls
+
+namespace
+{
+    // resolved on first use without a function static, its guard would lock a mutex
+    template <typename Fn>
+    Fn nextSymbol(std::atomic<Fn>& cached, const char* name)
+    {
+        auto fn = cached.load(std::memory_order_acquire);
+        if (fn == nullptr) {
+            fn = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+            cached.store(fn, std::memory_order_release);
+        }
+        return fn;
+    }
+
+    std::atomic<int (*)(pthread_mutex_t*)> nextMutexLock { nullptr };
+    std::atomic<int (*)(pthread_rwlock_t*)> nextRdLock { nullptr };
+    std::atomic<int (*)(pthread_rwlock_t*)> nextWrLock { nullptr };
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    if (RTAudit::locksHooked())
+        RTAudit::violation("mutex lock");
+    return nextSymbol(nextMutexLock, "pthread_mutex_lock")(mutex);
+}
+
+extern "C" int pthread_rwlock_rdlock(pthread_rwlock_t* lock)
+{
+    if (RTAudit::locksHooked())
+        RTAudit::violation("rwlock read lock");
+    return nextSymbol(nextRdLock, "pthread_rwlock_rdlock")(lock);
+}
+
+extern "C" int pthread_rwlock_wrlock(pthread_rwlock_t* lock)
+{
+    if (RTAudit::locksHooked())
+        RTAudit::violation("rwlock write lock");
+    return nextSymbol(nextWrLock, "pthread_rwlock_wrlock")(lock);
+}
+
+#endif
+
+#endif
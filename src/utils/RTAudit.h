@@ -0,0 +1,66 @@
+#pragma once
+
+#include <mutex>
+
+/**
+ * Real-time safety audit, compiled in with TIME12_RT_AUDIT (cmake -DRT_AUDIT=ON, debug builds).
+ * While an audit scope is open on a thread, heap allocations, frees and mutex locks
+ * made by that thread are reported on stderr with the tags of the open scopes,
+ * or abort the process after setAbort(true).
+ * On Linux every pthread mutex and rwlock lock can be reported too, including std::mutex and JUCE locks,
+ * once a test harness calls setHookLocks(true), the hooks forward silently otherwise
+ * so plugin binaries built with the audit behave as usual. Elsewhere only RTAudit::Lock is reported.
+ * Without TIME12_RT_AUDIT every call compiles to nothing.
+ */
+#if TIME12_RT_AUDIT && defined(__linux__)
+ #define TIME12_RT_AUDIT_PTHREAD 1
+#else
+ #define TIME12_RT_AUDIT_PTHREAD 0
+#endif
+
+namespace RTAudit
+{
+#if TIME12_RT_AUDIT
+    void enter(const char* tag);
+    void leave();
+    void violation(const char* what);
+    void setAbort(bool abort);
+    void setHookLocks(bool hook); // reports every pthread lock on Linux instead of only RTAudit::Lock
+    bool locksHooked();
+    int violations(); // total reported so far, lets a harness fail on any violation
+#else
+    inline void enter(const char*) {}
+    inline void leave() {}
+    inline void violation(const char*) {}
+    inline void setAbort(bool) {}
+    inline void setHookLocks(bool) {}
+    inline bool locksHooked() { return false; }
+    inline int violations() { return 0; }
+#endif
+
+    // audits the current thread until the end of the scope, scopes nest and their tags are reported
+    class Scope
+    {
+    public:
+        explicit Scope(const char* tag) { enter(tag); }
+        ~Scope() { leave(); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // std::lock_guard that is reported when taken inside an audit scope
+    class Lock
+    {
+    public:
+        explicit Lock(std::mutex& m) : guard(m)
+        {
+            if (!locksHooked()) // otherwise already reported by the pthread hook
+                violation("mutex lock");
+        }
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+
+    private:
+        std::lock_guard<std::mutex> guard;
+    };
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Wait-free single producer single consumer FIFO of small trivially copyable items.
+ * push is called from one thread and pop from another, neither ever blocks or allocates.
+ */
+template <typename T, uint32_t Capacity>
+class SPSCQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // producer side, returns false and drops the item when the queue is full
+    bool push(const T& item)
+    {
+        auto w = writeIndex.load(std::memory_order_relaxed);
+        if (w - readIndex.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[w & (Capacity - 1)] = item;
+        writeIndex.store(w + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns false when there is nothing to read
+    bool pop(T& item)
+    {
+        auto r = readIndex.load(std::memory_order_relaxed);
+        if (r == writeIndex.load(std::memory_order_acquire))
+            return false;
+        item = items[r & (Capacity - 1)];
+        readIndex.store(r + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> items{};
+    std::atomic<uint32_t> writeIndex { 0 }; // indices wrap, their difference is the item count
+    std::atomic<uint32_t> readIndex { 0 };
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+/**
+ * Memory budget shared by every undo journal of a plugin instance.
+ * Entries are stamped when pushed, once the total goes over the budget
+ * the oldest entry across all journals is evicted first.
+ * Journals always keep their most recent entry. Message thread only.
+ */
+class UndoBudget
+{
+public:
+    class Journal
+    {
+    public:
+        virtual ~Journal() = default;
+        virtual uint64_t oldestStamp() = 0; // UINT64_MAX when the journal has nothing to evict
+        virtual void evictOldest() = 0;
+    };
+
+    explicit UndoBudget(size_t budgetBytes) : budget(budgetBytes) {}
+    UndoBudget(const UndoBudget&) = delete;
+    UndoBudget& operator=(const UndoBudget&) = delete;
+
+    size_t size() const { return bytes; }
+    void add(Journal* journal) { journals.push_back(journal); }
+    void remove(Journal* journal) { journals.erase(std::remove(journals.begin(), journals.end(), journal), journals.end()); }
+    uint64_t stamp() { return ++clock; }
+    void charge(size_t n) { bytes += n; }
+    void refund(size_t n) { bytes -= n; }
+
+    // evicts the oldest entries across all journals until the total fits
+    void enforce()
+    {
+        while (bytes > budget) {
+            Journal* oldest = nullptr;
+            uint64_t oldestStamp = UINT64_MAX;
+            for (auto* journal : journals) {
+                auto stamp = journal->oldestStamp();
+                if (stamp < oldestStamp) {
+                    oldestStamp = stamp;
+                    oldest = journal;
+                }
+            }
+            if (!oldest)
+                return;
+            oldest->evictOldest();
+        }
+    }
+
+private:
+    std::vector<Journal*> journals;
+    size_t budget; // max bytes of stored elements
+    size_t bytes = 0;
+    uint64_t clock = 0;
+};
+
+/**
+ * Fixed capacity stack of undo states stored as deltas.
+ * Each entry keeps only the elements that differ from the entry below it,
+ * the unchanged prefix and suffix are shared. Every KEYFRAME_INTERVAL entries
+ * a full copy is stored so restoring a state never replays a long chain.
+ * The oldest entries are evicted once the capacity is reached,
+ * or by the shared UndoBudget once the instance goes over its memory budget.
+ */
+template <typename T, typename Equal>
+class UndoJournal : private UndoBudget::Journal
+{
+public:
+    static constexpr int KEYFRAME_INTERVAL = 16;
+
+    UndoJournal(int capacity, UndoBudget& undoBudget)
+        : entries((size_t)capacity), budget(undoBudget)
+    {
+        budget.add(this);
+    }
+
+    ~UndoJournal() override
+    {
+        budget.refund(bytes);
+        budget.remove(this);
+    }
+
+    UndoJournal(const UndoJournal&) = delete;
+    UndoJournal& operator=(const UndoJournal&) = delete;
+
+    bool empty() const { return count == 0; }
+    int size() const { return count; }
+
+    void clear()
+    {
+        for (auto& e : entries)
+            e = Entry();
+        head = 0;
+        count = 0;
+        refund(bytes);
+        top.clear();
+    }
+
+    void push(const std::vector<T>& state)
+    {
+        if (count == (int)entries.size())
+            evictOldest();
+
+        Entry entry;
+        entry.stamp = budget.stamp();
+        entry.keyframe = count == 0 || sinceKeyframe(count - 1) + 1 >= KEYFRAME_INTERVAL;
+        if (entry.keyframe) {
+            entry.items = state;
+        }
+        else {
+            Equal eq;
+            size_t maxCommon = std::min(top.size(), state.size());
+            size_t prefix = 0;
+            while (prefix < maxCommon && eq(top[prefix], state[prefix]))
+                prefix += 1;
+            size_t suffix = 0;
+            while (suffix < maxCommon - prefix && eq(top[top.size() - 1 - suffix], state[state.size() - 1 - suffix]))
+                suffix += 1;
+            entry.prefix = (int)prefix;
+            entry.suffix = (int)suffix;
+            entry.items.assign(state.begin() + prefix, state.end() - suffix);
+        }
+
+        charge(entry.items.size() * sizeof(T));
+        at(count) = std::move(entry);
+        count += 1;
+        top = state;
+        budget.enforce();
+    }
+
+    // removes and returns the most recent state
+    std::vector<T> pop()
+    {
+        auto state = std::move(top);
+        count -= 1;
+        refund(at(count).items.size() * sizeof(T));
+        at(count) = Entry();
+        top = count > 0 ? materialize(count - 1) : std::vector<T>();
+        return state;
+    }
+
+private:
+    struct Entry {
+        uint64_t stamp = 0; // push order across all journals sharing the budget
+        bool keyframe = false;
+        int prefix = 0; // elements shared with the start of the previous state
+        int suffix = 0; // elements shared with the end of the previous state
+        std::vector<T> items; // full state on keyframes, replaced middle otherwise
+    };
+
+    std::vector<Entry> entries; // ring buffer, index 0 is the oldest at head
+    UndoBudget& budget;
+    size_t bytes = 0; // this journal's share of the budget
+    int head = 0;
+    int count = 0;
+    std::vector<T> top; // most recent state, base for the next delta
+
+    Entry& at(int i) { return entries[(head + i) % entries.size()]; }
+
+    void charge(size_t n)
+    {
+        bytes += n;
+        budget.charge(n);
+    }
+
+    void refund(size_t n)
+    {
+        bytes -= n;
+        budget.refund(n);
+    }
+
+    uint64_t oldestStamp() override
+    {
+        return count > 1 ? at(0).stamp : UINT64_MAX;
+    }
+
+    int sinceKeyframe(int i)
+    {
+        int n = 0;
+        while (!at(i - n).keyframe)
+            n += 1;
+        return n;
+    }
+
+    std::vector<T> materialize(int i)
+    {
+        int k = i - sinceKeyframe(i);
+        std::vector<T> state = at(k).items;
+        for (int j = k + 1; j <= i; ++j) {
+            auto& e = at(j);
+            std::vector<T> next;
+            next.reserve(e.prefix + e.items.size() + e.suffix);
+            next.insert(next.end(), state.begin(), state.begin() + e.prefix);
+            next.insert(next.end(), e.items.begin(), e.items.end());
+            next.insert(next.end(), state.end() - e.suffix, state.end());
+            state = std::move(next);
+        }
+        return state;
+    }
+
+    void evictOldest() override
+    {
+        if (count > 1 && !at(1).keyframe) {
+            auto state = materialize(1); // next entry becomes the new base
+            refund(at(1).items.size() * sizeof(T));
+            charge(state.size() * sizeof(T));
+            at(1).keyframe = true;
+            at(1).prefix = 0;
+            at(1).suffix = 0;
+            at(1).items = std::move(state);
+        }
+        refund(at(0).items.size() * sizeof(T));
+        at(0) = Entry();
+        head = (head + 1) % (int)entries.size();
+        count -= 1;
+    }
+};
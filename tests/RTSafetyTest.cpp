@@ -0,0 +1,120 @@
+// Copyright 2025 tilr
+
+#include <JuceHeader.h>
+#include "../src/PluginProcessor.h"
+#include "../src/utils/RTAudit.h"
+
+#include <cmath>
+#include <cstdio>
+
+/*
+    Real-time safety test, built with cmake -DRT_AUDIT=ON -DCMAKE_BUILD_TYPE=Debug
+    Drives processBlock in every trigger mode with tension, pattern, anti-noise and MIDI changes
+    and exits non zero if the audio thread allocated, freed or locked
+*/
+
+namespace
+{
+    constexpr double SAMPLE_RATE = 48000.0;
+    constexpr int BLOCK_SIZE = 512;
+    constexpr int BLOCKS_PER_STEP = 64; // ~0.7 seconds per parameter change
+    constexpr int MIDI_CAPACITY = 4096; // bytes reserved in the block MidiBuffer
+
+    class TestPlayHead : public AudioPlayHead
+    {
+    public:
+        bool playing = true;
+        int64_t timeInSamples = 0;
+        double bpm = 120.0;
+
+        Optional<PositionInfo> getPosition() const override
+        {
+            PositionInfo info;
+            info.setIsPlaying(playing);
+            info.setBpm(bpm);
+            info.setTimeInSamples(timeInSamples);
+            info.setPpqPosition(timeInSamples / SAMPLE_RATE * bpm / 60.0);
+            return info;
+        }
+    };
+
+    void setParam(TIME12AudioProcessor& processor, const char* id, float value)
+    {
+        auto* param = processor.params.getParameter(id);
+        param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+}
+
+int main()
+{
+    ScopedJuceInitialiser_GUI juceInit;
+    RTAudit::setHookLocks(true); // std::mutex and JUCE locks too, not only RTAudit::Lock
+    TestPlayHead playHead;
+    TIME12AudioProcessor processor;
+    processor.setPlayHead(&playHead);
+    processor.setRateAndBufferSizeDetails(SAMPLE_RATE, BLOCK_SIZE);
+    processor.prepareToPlay(SAMPLE_RATE, BLOCK_SIZE);
+    processor.outputCC = 1; // exercise the CC output queue too
+    processor.timerCallback();
+
+    int channels = std::max(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+    AudioBuffer<float> buffer(channels, BLOCK_SIZE);
+    MidiBuffer midi;
+    midi.ensureSize(MIDI_CAPACITY);
+
+    // one block of the host callback, the message thread work runs between blocks as the timer would
+    auto runBlock = [&](int block) {
+        for (int c = 0; c < channels; ++c) {
+            auto* data = buffer.getWritePointer(c);
+            for (int i = 0; i < BLOCK_SIZE; ++i) {
+                auto t = playHead.timeInSamples + i;
+                auto burst = t % 12000 < 480 ? 0.8f : 0.01f; // transients for the audio trigger
+                data[i] = burst * (float)std::sin(t * 0.05);
+            }
+        }
+
+        midi.clear();
+        if (block % 16 == 0)
+            midi.addEvent(MidiMessage::noteOn(1, 60, (uint8)100), block % BLOCK_SIZE); // envelope trigger
+        if (block % 48 == 0)
+            midi.addEvent(MidiMessage::noteOn(10, 60 + block / 48 % 12, (uint8)100), 0); // pattern trigger
+
+        processor.processBlock(buffer, midi);
+        playHead.timeInSamples += BLOCK_SIZE;
+        processor.timerCallback();
+    };
+
+    const float triggers[] = { (float)Trigger::Sync, (float)Trigger::MIDI, (float)Trigger::Audio };
+    const float tensions[] = { 0.0f, 0.6f, -0.4f };
+    int block = 0;
+
+    for (auto trigger : triggers) {
+        setParam(processor, "trigger", trigger);
+        for (int step = 0; step < 6; ++step) {
+            setParam(processor, "tension", tensions[step % 3]);
+            setParam(processor, "pattern", (float)(step * 5 % 12 + 1));
+            setParam(processor, "patsync", (float)(step % 2 == 0 ? 0 : 3)); // immediate and beat synced switches
+            setParam(processor, "phase", step * 0.3f - std::floor(step * 0.3f));
+            setParam(processor, "mix", step % 2 == 0 ? 1.0f : 0.5f);
+            processor.setAntiNoise((ANoise)(step % 4));
+            if (step == 3) {
+                playHead.playing = false;
+                runBlock(block++);
+                playHead.playing = true;
+            }
+            for (int i = 0; i < BLOCKS_PER_STEP; ++i)
+                runBlock(block++);
+        }
+    }
+
+    processor.releaseResources();
+
+#if TIME12_RT_AUDIT
+    int violations = RTAudit::violations();
+    std::printf("RT safety: %d blocks, %d violations\n", block, violations);
+    return violations > 0 ? 1 : 0;
+#else
+    std::printf("RT safety: %d blocks, built without TIME12_RT_AUDIT, nothing was audited\n", block);
+    return 0;
+#endif
+}